@@ -0,0 +1,249 @@
+#include <time.h>
+#include "L2Cache2w.h"
+#include "Workload.h"
+
+/*------------------------------------------------------------------------------
+Measures how fast the simulator itself runs: replays a fixed set of access
+patterns through a fixed set of hierarchy configurations and reports, for
+each pair, simulated accesses per host second and host ns per access, one
+CSV row (or JSON object per line) per pair, so runs can be compared across
+versions.
+
+usage: bench [-f config] [-o key=value]... [-C key=v,key=v,...]... [-n accesses]
+             [-r repeats] [-J]
+  -f config       base configuration file
+  -o key=value    override one option of the base configuration
+  -C options      benchmark this configuration (base plus the options)
+                  instead of the built-in ones; repeatable
+  -n accesses     accesses per pattern (default BENCH_ACCESSES)
+  -r repeats      runs per pair, the fastest is reported (default 3)
+  -J              JSON, one object per line, instead of CSV
+
+Patterns are Workload streams (Workload.c), generated before the clock
+starts and replayed with accessBatch, on a hierarchy reset before every run:
+the times cover the simulator only. With cores > 1 the accesses go to the cores in turn.
+------------------------------------------------------------------------------*/
+
+#define BENCH_ACCESSES (1u << 20)
+#define MAX_CONFIGS 32
+
+typedef struct BenchConfig {
+  const char *name;
+  const char *options;   /* comma separated key=value, applied to the base */
+} BenchConfig;
+
+/* The hit and miss paths of every model that changes them. */
+static const BenchConfig Builtin[] = {
+  {"default", ""},
+  {"timing_only", "timing_only=1"},
+  {"l3", "levels=3"},
+  {"inclusive", "inclusion=inclusive"},
+  {"exclusive", "inclusion=exclusive"},
+  {"write_buffer", "l1_write=through,l1_write_buffer=8"},
+  {"prefetch", "l1_prefetch=stride,l2_prefetch=next"},
+  {"event", "timing=event"},
+  {"banked_dram", "dram_model=banked"},
+  {"quad_core", "cores=4"},
+  {"fast_forward", "warmup_mark=1"},   // the whole run is warmup: tags only
+};
+
+typedef struct Pattern {
+  const char *name;
+  const char *workload;  /* for parseWorkload (Workload.c) */
+} Pattern;
+
+/* Mostly the L1 hit path; every access a miss down to DRAM; misses with no
+   locality; dependent misses; a blocked kernel with reuse at every level. */
+static const Pattern Patterns[] = {
+  {"sequential", "sequential"},
+  {"strided", "strided:stride=4160,footprint=64M"},
+  {"random", "random:footprint=64M"},
+  {"pointer_chase", "chase:footprint=4M"},
+  {"tiled_matmul", "gemm:n=256,tile=32"},
+};
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+
+/*******************************************************************************
+Runs
+*******************************************************************************/
+
+/* Applies "key=v,key=v,..." to config. Returns 0 on success. */
+static int applyOptions(CacheConfig *config, const char *options) {
+
+  char option[80];
+
+  for (const char *p = options; *p;) {
+    size_t length = strcspn(p, ",");
+    if (length >= sizeof(option))
+      return -1;
+    memcpy(option, p, length);
+    option[length] = '\0';
+    if (length && setConfigOption(config, option) < 0)
+      return -1;
+    p += length + (p[length] == ',');
+  }
+  return 0;
+}
+
+static double hitRate(const LevelStats *stats) {
+  uint64_t total = stats->hits + stats->misses;
+  return total ? (double)stats->hits / total : 0.0;
+}
+
+/* The fastest of repeats runs of trace through h, in seconds; -1 if an access
+   is out of range (e.g. beyond dram_size). */
+static double timeRuns(Hierarchy *h, const TraceAccess *trace, size_t count, uint32_t repeats) {
+
+  double best = 0;
+
+  for (uint32_t r = 0; r < repeats; r++) {
+    resetHierarchy(h);
+    double start = seconds();
+    for (size_t done = 0; done < count; done += TRACE_BATCH_SIZE) {
+      size_t part = count - done < TRACE_BATCH_SIZE ? count - done : TRACE_BATCH_SIZE;
+      if (accessBatch(h, &trace[done], part) < part)
+        return -1;
+    }
+    flushWriteBuffers(h);
+    double elapsed = seconds() - start;
+    if (r == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+static void report(int json, const char *config, const char *pattern, const Hierarchy *h,
+                   size_t count, double elapsed) {
+
+  LevelStats l1 = {0};
+  double rate = elapsed > 0 ? count / elapsed : 0.0;
+  double ns = count ? elapsed * 1e9 / count : 0.0;
+
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    l1.hits += h->l1[core].stats.hits;
+    l1.misses += h->l1[core].stats.misses;
+  }
+
+  if (json)
+    printf("{\"config\":\"%s\",\"pattern\":\"%s\",\"accesses\":%zu,\"seconds\":%.6f,"
+           "\"accesses_per_second\":%.0f,\"ns_per_access\":%.2f,\"l1_hit_rate\":%.4f,"
+           "\"l2_hit_rate\":%.4f,\"simulated_time\":%llu}\n",
+           config, pattern, count, elapsed, rate, ns, hitRate(&l1), hitRate(&h->lower[0].stats),
+           (unsigned long long)h->time);
+  else
+    printf("%s,%s,%zu,%.6f,%.0f,%.2f,%.4f,%.4f,%llu\n", config, pattern, count, elapsed, rate,
+           ns, hitRate(&l1), hitRate(&h->lower[0].stats), (unsigned long long)h->time);
+}
+
+int main(int argc, char **argv) {
+
+  BenchConfig configs[MAX_CONFIGS];
+  CacheConfig base, config[MAX_CONFIGS];
+  Hierarchy *h[MAX_CONFIGS];
+  uint32_t numConfigs = 0, repeats = 3;
+  size_t count = BENCH_ACCESSES;
+  int json = 0;
+
+  defaultConfig(&base);
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      if (loadConfig(&base, argv[++i]) < 0)
+        return 1;
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      if (setConfigOption(&base, argv[++i]) < 0) {
+        fprintf(stderr, "invalid option: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc && numConfigs < MAX_CONFIGS) {
+      configs[numConfigs].name = argv[++i];
+      configs[numConfigs].options = argv[i];
+      numConfigs++;
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      count = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      repeats = (uint32_t)atoi(argv[++i]);
+    else if (strcmp(argv[i], "-J") == 0)
+      json = 1;
+    else {
+      fprintf(stderr, "usage: %s [-f config] [-o key=value]... [-C key=v,key=v,...]... "
+              "[-n accesses] [-r repeats] [-J]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (!numConfigs) {
+    numConfigs = sizeof(Builtin) / sizeof(Builtin[0]);
+    memcpy(configs, Builtin, sizeof(Builtin));
+  }
+  if (!repeats)
+    repeats = 1;
+
+  for (uint32_t c = 0; c < numConfigs; c++) {
+    config[c] = base;
+    if (applyOptions(&config[c], configs[c].options) < 0) {
+      fprintf(stderr, "invalid options: %s\n", configs[c].options);
+      return 1;
+    }
+    if (checkConfig(&config[c]) < 0)
+      return 1;
+    h[c] = createHierarchy(&config[c]);
+    if (!h[c]) {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+  }
+
+  TraceAccess *trace = malloc(count * sizeof(TraceAccess));
+  if (!trace) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  if (!json)
+    printf("config,pattern,accesses,seconds,accesses_per_second,ns_per_access,"
+           "l1_hit_rate,l2_hit_rate,simulated_time\n");
+
+  for (size_t p = 0; p < sizeof(Patterns) / sizeof(Patterns[0]); p++) {
+    WorkloadConfig pattern;
+    Workload workload;
+
+    defaultWorkload(&pattern);
+    if (parseWorkload(&pattern, Patterns[p].workload) < 0)
+      return 1;
+    pattern.accesses = count;
+    pattern.seed = base.seed;
+    if (openWorkload(&workload, &pattern) < 0)
+      return 1;
+    nextWorkloadBatch(&workload, trace, count);
+    closeWorkload(&workload);
+
+    for (uint32_t c = 0; c < numConfigs; c++) {
+      for (size_t i = 0; i < count; i++)
+        trace[i].core = (uint8_t)(i % config[c].cores);
+      double elapsed = timeRuns(h[c], trace, count, repeats);
+      if (elapsed < 0) {
+        fprintf(stderr, "%s: %s goes out of range\n", configs[c].name, Patterns[p].name);
+        return 1;
+      }
+      report(json, configs[c].name, Patterns[p].name, h[c], count, elapsed);
+      fflush(stdout);
+    }
+  }
+
+  for (uint32_t c = 0; c < numConfigs; c++)
+    destroyHierarchy(h[c]);
+  free(trace);
+
+  return 0;
+}
@@ -9,6 +9,7 @@
 
 #define MODE_READ 1
 #define MODE_WRITE 0
+#define MODE_MARK 2   // a marker in a trace, not an access
 
 #define DRAM_READ_TIME 100
 #define DRAM_WRITE_TIME 50
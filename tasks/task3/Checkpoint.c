@@ -0,0 +1,423 @@
+/*******************************************************************************
+*                                                                              *
+*                      Checkpoint and restore                                  *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Saves the complete state of a hierarchy to a file and restores it into
+another one, so a warmup can run once and many experiments start from it:
+every line of every level (tags, MESI state, data, replacement state,
+prefetch bookkeeping, counters), write buffers, victim caches, prefetchers,
+miss classifiers, the event timing MSHRs, the DRAM controller's banks and
+queue, the backing store and the clock.
+
+One walker (transferHierarchy) visits that state in a fixed order, writing
+each array when saving and reading it back when restoring, so the two can
+not drift apart. The arrays are sized by the config, which the file stores:
+a checkpoint restores into a hierarchy of the same shape, but latencies
+(l*_read_time, l*_write_time, victim_time and the dram_* times) may differ,
+to fork experiments over them, and so may warmup and warmup_mark. A
+hierarchy is not saved nor restored halfway through a warmup.
+
+Restoring maps the file (private, copy on write): the cache state is copied
+out of the mapping, and the DRAM pages are used in place by the backing
+store (Memory.c), so only the pages a run touches are read, and runs
+restored from the same file share them in the host's page cache.
+------------------------------------------------------------------------------*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Checkpoint.h"
+
+/* Where the state goes to (saving) or comes from (restoring). */
+typedef struct Transfer {
+  FILE *out;              /* NULL when restoring */
+  const uint8_t *cursor;  /* restoring: next byte of the mapping */
+  const uint8_t *end;
+  int error;
+} Transfer;
+
+
+
+/*******************************************************************************
+State walker
+*******************************************************************************/
+
+static void transfer(Transfer *t, void *data, size_t bytes) {
+
+  if (!bytes || t->error)
+    return;
+
+  if (t->out) {
+    if (fwrite(data, 1, bytes, t->out) != bytes)
+      t->error = 1;
+    return;
+  }
+  if ((size_t)(t->end - t->cursor) < bytes) {
+    t->error = 1;
+    return;
+  }
+  memcpy(data, t->cursor, bytes);
+  t->cursor += bytes;
+}
+
+/* Restoring: the count indices must be below limit (or NO_NODE, if none is
+   set), so that a foreign or damaged file can not point out of the arrays. */
+static void checkIndices(Transfer *t, const uint32_t *index, size_t count, uint32_t limit,
+                         int none) {
+  for (size_t i = 0; !t->out && !t->error && i < count; i++)
+    if (index[i] >= limit && !(none && index[i] == NO_NODE))
+      t->error = 1;
+}
+
+/* The shadow cache and the blocks seen, a table that grows with them. */
+static void transferClassifier(Transfer *t, Classifier *c) {
+
+  uint64_t seen = c->seen ? c->seenMask + 1 : 0;
+
+  transfer(t, &c->count, sizeof(c->count));
+  transfer(t, &c->head, sizeof(c->head));
+  transfer(t, &c->tail, sizeof(c->tail));
+  transfer(t, c->blocks, c->capacity * sizeof(uint64_t));
+  transfer(t, c->prev, c->capacity * sizeof(uint32_t));
+  transfer(t, c->next, c->capacity * sizeof(uint32_t));
+  transfer(t, c->table, ((size_t)c->tableMask + 1) * sizeof(uint32_t));
+  checkIndices(t, &c->head, 1, c->count, 1);
+  checkIndices(t, &c->tail, 1, c->count, 1);
+  checkIndices(t, c->prev, c->count, c->count, 1);
+  checkIndices(t, c->next, c->count, c->count, 1);
+  checkIndices(t, c->table, (size_t)c->tableMask + 1, c->count + 1, 0);
+  transfer(t, &c->seenCount, sizeof(c->seenCount));
+  transfer(t, &c->seenMask, sizeof(c->seenMask));
+  transfer(t, &seen, sizeof(seen));
+
+  if (!t->out && (c->count > c->capacity || (seen & (seen - 1)) ||
+                  (seen && (c->seenMask != seen - 1 || c->seenCount >= seen))))
+    t->error = 1;
+  if (!t->out && !t->error) {
+    free(c->seen);
+    c->seen = seen ? malloc(seen * sizeof(uint64_t)) : NULL;
+    if (seen && !c->seen)
+      t->error = 1;
+  }
+  transfer(t, c->seen, seen * sizeof(uint64_t));
+}
+
+static void transferBuffer(Transfer *t, WriteBuffer *buffer) {
+
+  size_t bytes = (size_t)buffer->capacity * buffer->blockSize;
+
+  transfer(t, &buffer->count, sizeof(buffer->count));
+  if (buffer->count > buffer->capacity)
+    t->error = 1;
+  transfer(t, buffer->order, buffer->capacity * sizeof(uint32_t));
+  checkIndices(t, buffer->order, buffer->count, buffer->capacity, 0);
+  transfer(t, buffer->blocks, buffer->capacity * sizeof(uint64_t));
+  transfer(t, buffer->queued, buffer->capacity * sizeof(uint64_t));
+  transfer(t, buffer->valid, bytes);
+  if (buffer->data)
+    transfer(t, buffer->data, bytes);
+  transfer(t, &buffer->drainTime, sizeof(buffer->drainTime));
+}
+
+/* What a prefetcher learned and has in flight; its policy, degree and page
+   shift come from the config. */
+static void transferPrefetcher(Transfer *t, Prefetcher *p) {
+  transfer(t, p->stride, sizeof(p->stride));
+  transfer(t, p->stream, sizeof(p->stream));
+  transfer(t, &p->clock, sizeof(p->clock));
+  transfer(t, &p->engineFree, sizeof(p->engineFree));
+  transfer(t, p->pending, sizeof(p->pending));
+  transfer(t, &p->next, sizeof(p->next));
+  if (p->next >= PREFETCH_QUEUE)
+    t->error = 1;
+  transfer(t, p->evicted, sizeof(p->evicted));
+}
+
+static void transferLevel(Transfer *t, Cache *cache) {
+
+  const Geometry *geometry = &cache->geometry;
+  size_t lines = (size_t)geometry->sets * geometry->ways;
+
+  transfer(t, cache->tags, lines * sizeof(uint64_t));
+  transfer(t, cache->dirty, lines);
+  if (cache->shared) {
+    transfer(t, cache->shared, lines);
+    transfer(t, cache->stale, lines * sizeof(uint64_t));
+  }
+  if (cache->data)
+    transfer(t, cache->data, lines * geometry->blockSize);
+
+  transfer(t, cache->repl.state, lines);
+  if (cache->repl.newer)
+    transfer(t, cache->repl.newer, lines);
+  transfer(t, cache->repl.tree, geometry->sets * sizeof(uint64_t));
+  transfer(t, &cache->repl.random, sizeof(cache->repl.random));
+  if (!t->out && !t->error && checkReplacement(&cache->repl) < 0)
+    t->error = 1;
+
+  if (cache->prefetcher) {
+    transferPrefetcher(t, cache->prefetcher);
+    transfer(t, cache->prefetched, lines);
+    transfer(t, cache->start, lines * sizeof(uint64_t));
+    transfer(t, cache->ready, lines * sizeof(uint64_t));
+  }
+  if (cache->buffer)
+    transferBuffer(t, cache->buffer);
+  if (cache->victim)
+    transferLevel(t, cache->victim);
+  if (cache->classifier)
+    transferClassifier(t, cache->classifier);
+
+  transfer(t, &cache->stats, sizeof(LevelStats));
+}
+
+static void transferMshrs(Transfer *t, MshrFile *mshrs) {
+  transfer(t, mshrs->blocks, mshrs->capacity * sizeof(uint64_t));
+  transfer(t, mshrs->ready, mshrs->capacity * sizeof(uint64_t));
+  transfer(t, &mshrs->release.count, sizeof(mshrs->release.count));
+  if (mshrs->release.count > mshrs->release.capacity)
+    t->error = 1;
+  transfer(t, mshrs->release.events, mshrs->release.capacity * sizeof(Event));
+  for (uint32_t i = 0; !t->out && !t->error && i < mshrs->release.count; i++)
+    if (mshrs->release.events[i].id >= mshrs->capacity)
+      t->error = 1;
+}
+
+/* Everything but h->time and the DRAM contents, stored apart. */
+static void transferHierarchy(Transfer *t, Hierarchy *h) {
+
+  for (uint32_t core = 0; core < h->config.cores; core++)
+    transferLevel(t, &h->l1[core]);
+  for (uint32_t i = 0; i < h->config.levels - 1; i++)
+    transferLevel(t, &h->lower[i]);
+  transfer(t, &h->dramStats, sizeof(DramStats));
+
+  if (h->timing) {
+    transfer(t, h->timing->clock, h->config.cores * sizeof(uint64_t));
+    for (uint32_t core = 0; core < h->config.cores; core++)
+      transferMshrs(t, &h->timing->l1[core]);
+    for (uint32_t i = 0; i < h->timing->shared; i++)
+      transferMshrs(t, &h->timing->lower[i]);
+    transfer(t, &h->timing->finish, sizeof(h->timing->finish));
+  }
+
+  if (h->controller) {
+    DramController *d = h->controller;
+    transfer(t, d->bank, (size_t)d->channels * d->ranks * d->banks * sizeof(DramBank));
+    transfer(t, d->busFree, d->channels * sizeof(uint64_t));
+    transfer(t, &d->count, sizeof(d->count));
+    if (d->count > d->capacity) // restoring a foreign file
+      t->error = 1;
+    transfer(t, d->queue, d->count * sizeof(DramRequest));
+    for (uint32_t i = 0; !t->out && !t->error && i < d->count; i++)
+      if (d->queue[i].channel >= d->channels || d->queue[i].bank >= d->channels * d->ranks * d->banks)
+        t->error = 1;
+  }
+}
+
+/* Where the page numbers start: after the state, 8 byte aligned. */
+static inline uint64_t keyOffset(const CheckpointHeader *header) {
+  return (sizeof(CheckpointHeader) + header->stateSize + 7) & ~(uint64_t)7;
+}
+
+/* 1 if b differs from a in latencies (and warmup) at most; the levels beyond
+   a->levels do not count. */
+static int sameShape(const CacheConfig *a, const CacheConfig *b) {
+
+  CacheConfig shape = *b;
+
+  for (uint32_t i = 0; i < MAX_LEVELS; i++) {
+    if (i >= a->levels)
+      shape.level[i] = a->level[i];
+    shape.level[i].readTime = a->level[i].readTime;
+    shape.level[i].writeTime = a->level[i].writeTime;
+  }
+  shape.victimTime = a->victimTime;
+  shape.dramReadTime = a->dramReadTime;
+  shape.dramWriteTime = a->dramWriteTime;
+  shape.dramRowHit = a->dramRowHit;
+  shape.dramRowMiss = a->dramRowMiss;
+  shape.dramRowConflict = a->dramRowConflict;
+  shape.dramBurst = a->dramBurst;
+  shape.warmup = a->warmup;
+  shape.warmupMark = a->warmupMark;
+  return memcmp(&shape, a, sizeof(shape)) == 0;
+}
+
+
+
+/*******************************************************************************
+Interface
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Writes the state of h to path. Pending write buffer entries and outstanding
+misses are saved as they are.
+Returns 0 on success, -1 on error (a message is printed to stderr).
+------------------------------------------------------------------------------*/
+int saveCheckpoint(const Hierarchy *h, const char *path) {
+
+  CheckpointHeader header;
+  Transfer t = {NULL, NULL, NULL, 0};
+  const BackingStore *m = h->dram;
+
+  if (h->warm && h->warm->active) {
+    fprintf(stderr, "%s: the hierarchy is still fast-forwarding\n", path);
+    return -1;
+  }
+  t.out = fopen(path, "wb");
+  if (!t.out) {
+    perror(path);
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+  header.version = CHECKPOINT_VERSION;
+  header.headerSize = sizeof(header);
+  header.config = h->config;
+  header.config.warmup = 0;       // what restores from it is warm already
+  header.config.warmupMark = 0;
+  header.time = h->time;
+  header.pages = m ? m->count : 0;
+  transfer(&t, &header, sizeof(header));
+
+  // the walker only reads the hierarchy when saving
+  transferHierarchy(&t, (Hierarchy *)h);
+  header.stateSize = (uint64_t)ftell(t.out) - sizeof(header);
+
+  uint64_t padding = 0;
+  transfer(&t, &padding, keyOffset(&header) - sizeof(header) - header.stateSize);
+
+  for (uint64_t i = 0; m && i <= m->mask; i++)
+    if (m->keys[i] != UINT64_MAX)
+      transfer(&t, &m->keys[i], sizeof(uint64_t));
+
+  header.pageOffset = (uint64_t)ftell(t.out);
+  if (header.pages)
+    header.pageOffset = (header.pageOffset + CHECKPOINT_ALIGN - 1) & ~(uint64_t)(CHECKPOINT_ALIGN - 1);
+  if (!t.error && fseek(t.out, (long)header.pageOffset, SEEK_SET) < 0)
+    t.error = 1;
+  for (uint64_t i = 0; m && i <= m->mask; i++)
+    if (m->keys[i] != UINT64_MAX)
+      transfer(&t, m->pages[i], MEMORY_PAGE_SIZE);
+
+  if (!t.error && fseek(t.out, 0, SEEK_SET) < 0)
+    t.error = 1;
+  transfer(&t, &header, sizeof(header));
+  if (fclose(t.out) != 0)
+    t.error = 1;
+
+  if (t.error) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+/* Maps path and checks its header. Returns the mapping, or NULL. */
+static uint8_t *mapCheckpoint(const char *path, size_t *length) {
+
+  struct stat info;
+  CheckpointHeader header;
+  uint8_t *map;
+  FILE *in = fopen(path, "rb");
+
+  if (!in || fstat(fileno(in), &info) < 0) {
+    perror(path);
+    if (in)
+      fclose(in);
+    return NULL;
+  }
+
+  *length = (size_t)info.st_size;
+  map = *length >= sizeof(header) ?
+        mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(in), 0) : MAP_FAILED;
+  fclose(in);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: not a checkpoint\n", path);
+    return NULL;
+  }
+
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0 || header.version != CHECKPOINT_VERSION ||
+      header.headerSize != sizeof(header) ||
+      header.stateSize > *length || header.pages > *length / sizeof(uint64_t) ||
+      header.pageOffset < keyOffset(&header) + header.pages * sizeof(uint64_t) ||
+      header.pageOffset > *length ||
+      header.pages > (*length - header.pageOffset) / MEMORY_PAGE_SIZE) {
+    fprintf(stderr, "%s: not a checkpoint of this version\n", path);
+    munmap(map, *length);
+    return NULL;
+  }
+  return map;
+}
+
+/*------------------------------------------------------------------------------
+Reads the config a checkpoint was taken with, to build a hierarchy for it.
+Returns 0 on success, -1 on error (a message is printed to stderr).
+------------------------------------------------------------------------------*/
+int readCheckpointConfig(const char *path, CacheConfig *config) {
+
+  size_t length;
+  uint8_t *map = mapCheckpoint(path, &length);
+
+  if (!map)
+    return -1;
+  memcpy(config, &((const CheckpointHeader *)map)->config, sizeof(CacheConfig));
+  munmap(map, length);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Replaces the state of h (built from the checkpoint's config, latencies and
+warmup aside) with the one saved in path, before its warmup begins.
+Listener and event log are kept.
+Returns 0 on success, -1 on error (a message is printed to stderr).
+------------------------------------------------------------------------------*/
+int restoreCheckpoint(Hierarchy *h, const char *path) {
+
+  CheckpointHeader header;
+  size_t length;
+  uint8_t *map = mapCheckpoint(path, &length);
+  Transfer t = {NULL, NULL, NULL, 0};
+
+  if (!map)
+    return -1;
+  memcpy(&header, map, sizeof(header));
+
+  if (h->warm && h->warm->active) {
+    fprintf(stderr, "%s: the hierarchy is already fast-forwarding\n", path);
+    munmap(map, length);
+    return -1;
+  }
+  if (!sameShape(&header.config, &h->config)) {
+    fprintf(stderr, "%s: checkpoint of a different hierarchy\n", path);
+    munmap(map, length);
+    return -1;
+  }
+
+  t.cursor = map + sizeof(header);
+  t.end = t.cursor + header.stateSize;
+  transferHierarchy(&t, h);
+  if (t.error || t.cursor != t.end) {
+    fprintf(stderr, "%s: truncated checkpoint\n", path);
+    munmap(map, length);
+    return -1;
+  }
+  h->time = header.time;
+
+  if (!h->dram) {
+    munmap(map, length);
+    return 0;
+  }
+  if (adoptPages(h->dram, (const uint64_t *)(map + keyOffset(&header)), map + header.pageOffset,
+                 header.pages, map, length) < 0) {
+    fprintf(stderr, "%s: corrupt page table\n", path);
+    munmap(map, length);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include "L2Cache2w.h"
+
+#define CHECKPOINT_MAGIC "OC1CHKPT"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_ALIGN (1u << 16)  // page contents offset: a multiple of any host page
+
+/* A checkpoint file: this header, the state of every level, timing model
+   and DRAM controller (stateSize bytes), the page numbers of the resident
+   DRAM pages, then, from pageOffset (a multiple of CHECKPOINT_ALIGN),
+   their contents. Structures are stored as they are in memory, so a
+   checkpoint is read back by a build with the same layout: version and
+   headerSize catch the changes. */
+typedef struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  CacheConfig config;
+  uint64_t time;
+  uint64_t stateSize;
+  uint64_t pages;
+  uint64_t pageOffset;
+} CheckpointHeader;
+
+int saveCheckpoint(const Hierarchy *, const char *);
+
+int readCheckpointConfig(const char *, CacheConfig *);
+
+int restoreCheckpoint(Hierarchy *, const char *);
+
+#endif
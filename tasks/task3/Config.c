@@ -0,0 +1,418 @@
+/*******************************************************************************
+*                                                                              *
+*                      Runtime cache configuration                             *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Geometry and latencies of the hierarchy are read at runtime from "key = value"
+lines (config file, '#' starts a comment) or from "key=value" command line
+options, instead of being fixed by the Cache.h macros.
+------------------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Config.h"
+#include "Dram.h"
+#include "Prefetch.h"
+#include "Replacement.h"
+#include "Timing.h"
+#include "WriteBuffer.h"
+
+const char *const InclusionNames[] = {"nine", "inclusive", "exclusive", NULL};
+
+typedef struct ConfigKey {
+  const char *name;
+  size_t field;
+  const char *const *names;  /* for enumerations: accepted values, by number */
+} ConfigKey;
+
+/* The keys of cache level i, prefix "l1", "l2", ... */
+#define LEVEL_KEYS(prefix, i) \
+  {prefix "_size", offsetof(CacheConfig, level[i].size), NULL}, \
+  {prefix "_ways", offsetof(CacheConfig, level[i].ways), NULL}, \
+  {prefix "_read_time", offsetof(CacheConfig, level[i].readTime), NULL}, \
+  {prefix "_write_time", offsetof(CacheConfig, level[i].writeTime), NULL}, \
+  {prefix "_policy", offsetof(CacheConfig, level[i].policy), ReplacementNames}, \
+  {prefix "_write", offsetof(CacheConfig, level[i].write), WritePolicyNames}, \
+  {prefix "_allocate", offsetof(CacheConfig, level[i].allocate), NULL}, \
+  {prefix "_write_buffer", offsetof(CacheConfig, level[i].writeBuffer), NULL}, \
+  {prefix "_prefetch", offsetof(CacheConfig, level[i].prefetch), PrefetchNames}, \
+  {prefix "_prefetch_degree", offsetof(CacheConfig, level[i].prefetchDegree), NULL}, \
+  {prefix "_mshrs", offsetof(CacheConfig, level[i].mshrs), NULL}
+
+static const ConfigKey Keys[] = {
+  {"block_size", offsetof(CacheConfig, blockSize), NULL},
+  {"dram_size", offsetof(CacheConfig, dramSize), NULL},
+  {"cores", offsetof(CacheConfig, cores), NULL},
+  {"levels", offsetof(CacheConfig, levels), NULL},
+  LEVEL_KEYS("l1", 0),
+  LEVEL_KEYS("l2", 1),
+  LEVEL_KEYS("l3", 2),
+  LEVEL_KEYS("l4", 3),
+  {"victim_entries", offsetof(CacheConfig, victimEntries), NULL},
+  {"victim_time", offsetof(CacheConfig, victimTime), NULL},
+  {"inclusion", offsetof(CacheConfig, inclusion), InclusionNames},
+  {"dram_read_time", offsetof(CacheConfig, dramReadTime), NULL},
+  {"dram_write_time", offsetof(CacheConfig, dramWriteTime), NULL},
+  {"dram_model", offsetof(CacheConfig, dramModel), DramModelNames},
+  {"dram_channels", offsetof(CacheConfig, dramChannels), NULL},
+  {"dram_ranks", offsetof(CacheConfig, dramRanks), NULL},
+  {"dram_banks", offsetof(CacheConfig, dramBanks), NULL},
+  {"dram_row_size", offsetof(CacheConfig, dramRowSize), NULL},
+  {"dram_page", offsetof(CacheConfig, dramPage), PagePolicyNames},
+  {"dram_mapping", offsetof(CacheConfig, dramMapping), AddressMappingNames},
+  {"dram_row_hit", offsetof(CacheConfig, dramRowHit), NULL},
+  {"dram_row_miss", offsetof(CacheConfig, dramRowMiss), NULL},
+  {"dram_row_conflict", offsetof(CacheConfig, dramRowConflict), NULL},
+  {"dram_burst", offsetof(CacheConfig, dramBurst), NULL},
+  {"dram_queue", offsetof(CacheConfig, dramQueue), NULL},
+  {"seed", offsetof(CacheConfig, seed), NULL},
+  {"timing", offsetof(CacheConfig, timing), TimingNames},
+  {"timing_only", offsetof(CacheConfig, timingOnly), NULL},
+  {"classify_misses", offsetof(CacheConfig, classifyMisses), NULL},
+  {"warmup", offsetof(CacheConfig, warmup), NULL},
+  {"warmup_mark", offsetof(CacheConfig, warmupMark), NULL},
+};
+
+#define NUM_KEYS (sizeof(Keys) / sizeof(Keys[0]))
+
+/* Every value is a uint32_t but dram_size, which may pass 4G. */
+static int isWide(size_t field) {
+  return field == offsetof(CacheConfig, dramSize);
+}
+
+
+
+/*******************************************************************************
+Configuration
+*******************************************************************************/
+
+static void defaultLevel(LevelConfig *level, uint32_t size, uint32_t ways, uint32_t readTime,
+                         uint32_t writeTime) {
+  level->size = size;
+  level->ways = ways;
+  level->readTime = readTime;
+  level->writeTime = writeTime;
+  level->policy = REPL_LRU;
+  level->write = WRITE_BACK;
+  level->allocate = 1;
+  level->writeBuffer = 0;
+  level->prefetch = PREFETCH_NONE;
+  level->prefetchDegree = 2;
+  level->mshrs = 16;
+}
+
+/*------------------------------------------------------------------------------
+Fills config with the compile time defaults of Cache.h (L3 and L4, unused
+unless levels says so, get sizes and latencies of their own).
+------------------------------------------------------------------------------*/
+void defaultConfig(CacheConfig *config) {
+  config->blockSize = BLOCK_SIZE;
+  config->dramSize = 0; // no bound: DRAM is sparse over 64 bit addresses
+  config->cores = 1;
+  config->levels = 2;
+  defaultLevel(&config->level[0], L1_SIZE, 1, L1_READ_TIME, L1_WRITE_TIME);
+  config->level[0].mshrs = 8;
+  defaultLevel(&config->level[1], L2_SIZE, 2, L2_READ_TIME, L2_WRITE_TIME);
+  defaultLevel(&config->level[2], 256 * 1024, 8, 30, 15);
+  defaultLevel(&config->level[3], 1024 * 1024, 16, 50, 25);
+  config->victimEntries = 0;
+  config->victimTime = 1;
+  config->inclusion = INCLUSION_NINE;
+
+  config->dramReadTime = DRAM_READ_TIME;
+  config->dramWriteTime = DRAM_WRITE_TIME;
+  config->dramModel = DRAM_FLAT;
+  config->dramChannels = 1;
+  config->dramRanks = 1;
+  config->dramBanks = 8;
+  config->dramRowSize = 2048;
+  config->dramPage = PAGE_OPEN;
+  config->dramMapping = MAP_ROW_BANK_COL;
+  config->dramRowHit = 50;
+  config->dramRowMiss = 100;
+  config->dramRowConflict = 150;
+  config->dramBurst = 4;
+  config->dramQueue = 16;
+
+  config->seed = 1;
+
+  config->timing = TIMING_SERIAL;
+
+  config->timingOnly = 0;
+  config->classifyMisses = 0;
+  config->warmup = 0;
+  config->warmupMark = 0;
+}
+
+/*------------------------------------------------------------------------------
+Parses a size with an optional K/M/G suffix ("32K" = 32768).
+------------------------------------------------------------------------------*/
+static int parseSize(const char *text, uint64_t *out) {
+
+  char *end;
+  unsigned long long value;
+  uint32_t shift = 0;
+
+  errno = 0;
+  value = strtoull(text, &end, 0);
+  if (end == text || errno)
+    return -1;
+
+  switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+  }
+  if (value > UINT64_MAX >> shift)
+    return -1;
+  value <<= shift;
+
+  while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+    end++;
+  if (*end != '\0')
+    return -1;
+
+  *out = value;
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Looks value up in a NULL terminated list of names ("lru", "plru", ...).
+------------------------------------------------------------------------------*/
+static int parseName(const char *text, const char *const *names, uint32_t *out) {
+
+  size_t length = strcspn(text, " \t\r\n");
+
+  for (uint32_t i = 0; names[i]; i++) {
+    if (strlen(names[i]) == length && strncmp(names[i], text, length) == 0) {
+      *out = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*------------------------------------------------------------------------------
+Applies one "key=value" (or "key = value") option.
+Returns 0 on success, -1 if the key or value is not valid.
+------------------------------------------------------------------------------*/
+int setConfigOption(CacheConfig *config, const char *option) {
+
+  const char *equals = strchr(option, '=');
+  const char *value;
+  size_t length;
+
+  if (!equals)
+    return -1;
+
+  length = (size_t)(equals - option);
+  while (length > 0 && (option[length - 1] == ' ' || option[length - 1] == '\t'))
+    length--;
+
+  value = equals + 1;
+  while (*value == ' ' || *value == '\t')
+    value++;
+
+  for (size_t i = 0; i < NUM_KEYS; i++) {
+    if (strlen(Keys[i].name) != length || strncmp(Keys[i].name, option, length) != 0)
+      continue;
+    char *field = (char *)config + Keys[i].field;
+    uint64_t size;
+    if (Keys[i].names)
+      return parseName(value, Keys[i].names, (uint32_t *)field);
+    if (parseSize(value, &size) < 0)
+      return -1;
+    if (isWide(Keys[i].field))
+      *(uint64_t *)field = size;
+    else if (size <= UINT32_MAX)
+      *(uint32_t *)field = (uint32_t)size;
+    else
+      return -1;
+    return 0;
+  }
+  return -1;
+}
+
+/*------------------------------------------------------------------------------
+Reads a config file on top of the values already in config.
+Returns 0 on success, -1 on error (a message is printed to stderr).
+------------------------------------------------------------------------------*/
+int loadConfig(CacheConfig *config, const char *path) {
+
+  char line[256];
+  int number = 0;
+  FILE *file = fopen(path, "r");
+
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), file)) {
+    char *p = line;
+    char *comment = strchr(line, '#');
+
+    number++;
+    if (comment)
+      *comment = '\0';
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '\0' || *p == '\n' || *p == '\r')
+      continue;
+
+    if (setConfigOption(config, p) < 0) {
+      fprintf(stderr, "%s:%d: invalid option: %s", path, number, p);
+      fclose(file);
+      return -1;
+    }
+  }
+
+  fclose(file);
+  return 0;
+}
+
+static int isPowerOfTwo(uint32_t value) {
+  return value && !(value & (value - 1));
+}
+
+static int checkLevel(const char *name, const LevelConfig *level, uint32_t blockSize) {
+
+  uint32_t size = level->size, ways = level->ways;
+
+  if (!ways || size % blockSize || (size / blockSize) % ways ||
+      !isPowerOfTwo(size / blockSize / ways)) {
+    fprintf(stderr, "%s: size must hold a power of two number of sets of %u ways\n",
+            name, ways);
+    return -1;
+  }
+  if (ways > MAX_WAYS) {
+    fprintf(stderr, "%s: at most %d ways\n", name, MAX_WAYS);
+    return -1;
+  }
+  if (level->policy == REPL_PLRU && !isPowerOfTwo(ways)) {
+    fprintf(stderr, "%s: plru needs a power of two number of ways\n", name);
+    return -1;
+  }
+  if (level->allocate > 1 || level->writeBuffer > MAX_WRITE_BUFFER) {
+    fprintf(stderr, "%s: allocate must be 0 or 1, write_buffer at most %d entries\n",
+            name, MAX_WRITE_BUFFER);
+    return -1;
+  }
+  if (!level->prefetchDegree || level->prefetchDegree > MAX_PREFETCH_DEGREE) {
+    fprintf(stderr, "%s: prefetch_degree must be between 1 and %d\n", name,
+            MAX_PREFETCH_DEGREE);
+    return -1;
+  }
+  if (!level->mshrs || level->mshrs > MAX_MSHRS) {
+    fprintf(stderr, "%s: mshrs must be between 1 and %d\n", name, MAX_MSHRS);
+    return -1;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Checks that every level can be indexed with shifts and masks.
+------------------------------------------------------------------------------*/
+int checkConfig(const CacheConfig *config) {
+
+  if (!isPowerOfTwo(config->blockSize) || config->blockSize < WORD_SIZE ||
+      config->blockSize > MAX_BLOCK_SIZE) {
+    fprintf(stderr, "block_size must be a power of two between %d and %d bytes\n",
+            WORD_SIZE, MAX_BLOCK_SIZE);
+    return -1;
+  }
+  if (config->dramSize % config->blockSize) {
+    fprintf(stderr, "dram_size must be a multiple of block_size (or 0)\n");
+    return -1;
+  }
+  if (!isPowerOfTwo(config->dramChannels) || !isPowerOfTwo(config->dramRanks) ||
+      !isPowerOfTwo(config->dramBanks) ||
+      (uint64_t)config->dramChannels * config->dramRanks * config->dramBanks > MAX_DRAM_BANKS) {
+    fprintf(stderr, "dram_channels, dram_ranks and dram_banks must be powers of two, "
+            "with at most %d banks in all\n", MAX_DRAM_BANKS);
+    return -1;
+  }
+  if (!isPowerOfTwo(config->dramRowSize) || config->dramRowSize < config->blockSize) {
+    fprintf(stderr, "dram_row_size must be a power of two of at least block_size\n");
+    return -1;
+  }
+  if (config->dramRowMiss < config->dramRowHit || config->dramRowConflict < config->dramRowMiss) {
+    fprintf(stderr, "dram_row_hit <= dram_row_miss <= dram_row_conflict\n");
+    return -1;
+  }
+  if (!config->dramQueue || config->dramQueue > MAX_DRAM_QUEUE) {
+    fprintf(stderr, "dram_queue must be between 1 and %d\n", MAX_DRAM_QUEUE);
+    return -1;
+  }
+  if (config->victimEntries > MAX_WAYS) {
+    fprintf(stderr, "victim_entries: at most %d\n", MAX_WAYS);
+    return -1;
+  }
+  if (config->inclusion == INCLUSION_EXCLUSIVE &&
+      (config->level[0].write != WRITE_BACK || !config->level[0].allocate)) {
+    fprintf(stderr, "inclusion = exclusive needs l1_write = back and l1_allocate = 1\n");
+    return -1;
+  }
+  if (!config->cores || config->cores > MAX_CORES) {
+    fprintf(stderr, "cores must be between 1 and %d\n", MAX_CORES);
+    return -1;
+  }
+  if (config->levels < 2 || config->levels > MAX_LEVELS) {
+    fprintf(stderr, "levels must be between 2 and %d\n", MAX_LEVELS);
+    return -1;
+  }
+  for (uint32_t i = 0; i < config->levels; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "l%u", i + 1);
+    if (checkLevel(name, &config->level[i], config->blockSize) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+void printConfig(FILE *out, const CacheConfig *config) {
+  for (size_t i = 0; i < NUM_KEYS; i++) {
+    const char *field = (const char *)config + Keys[i].field;
+    uint32_t value = *(const uint32_t *)field;
+    if (Keys[i].names)
+      fprintf(out, "%s = %s\n", Keys[i].name, Keys[i].names[value]);
+    else if (isWide(Keys[i].field))
+      fprintf(out, "%s = %llu\n", Keys[i].name, (unsigned long long)*(const uint64_t *)field);
+    else
+      fprintf(out, "%s = %u\n", Keys[i].name, value);
+  }
+}
+
+
+
+/*******************************************************************************
+Address processing
+*******************************************************************************/
+
+static uint32_t log2u(uint32_t value) {
+  uint32_t bits = 0;
+  while ((1u << bits) < value)
+    bits++;
+  return bits;
+}
+
+/*------------------------------------------------------------------------------
+Precomputes the shifts and masks of a level of size bytes with the given ways.
+The config must have passed checkConfig.
+------------------------------------------------------------------------------*/
+void makeGeometry(Geometry *geometry, uint32_t size, uint32_t ways, uint32_t blockSize) {
+  geometry->blockSize = blockSize;
+  geometry->ways = ways;
+  geometry->sets = size / blockSize / ways;
+  geometry->offsetBits = log2u(blockSize);
+  geometry->indexBits = log2u(geometry->sets);
+  geometry->tagShift = geometry->offsetBits + geometry->indexBits;
+  geometry->offsetMask = blockSize - 1;
+  geometry->indexMask = geometry->sets - 1;
+}
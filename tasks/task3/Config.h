@@ -0,0 +1,122 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Cache.h"
+
+#define MAX_BLOCK_SIZE 4096   // largest block_size accepted at runtime
+#define MAX_CORES 64          // private L1s sharing the L2
+#define MAX_LEVELS 4          // cache levels: L1s, L2, L3 and L4
+
+/* What L2 holds of the blocks in the L1s. */
+typedef enum InclusionPolicy {
+  INCLUSION_NINE,       /* neither inclusive nor exclusive: L2 keeps what it fetched */
+  INCLUSION_INCLUSIVE,  /* every L1 block is in L2: L2 evictions back-invalidate L1s */
+  INCLUSION_EXCLUSIVE   /* L1 fills leave L2, L1 victims (clean or dirty) go to L2 */
+} InclusionPolicy;
+
+extern const char *const InclusionNames[];
+
+/*********************** Configuration *************************/
+
+/* One cache level (the L1s: each of them). */
+typedef struct LevelConfig {
+  uint32_t size;        /* in bytes */
+  uint32_t ways;
+  uint32_t readTime;
+  uint32_t writeTime;
+  uint32_t policy;      /* ReplacementPolicy */
+  uint32_t write;       /* WritePolicy */
+  uint32_t allocate;    /* 1: write misses fetch the block */
+  uint32_t writeBuffer; /* entries, 0 = writes go down synchronously */
+  uint32_t prefetch;    /* PrefetchPolicy */
+  uint32_t prefetchDegree; /* blocks proposed per trigger */
+  uint32_t mshrs;       /* outstanding misses (timing = event), per L1 */
+} LevelConfig;
+
+/* Runtime description of the hierarchy; defaults come from Cache.h. */
+typedef struct CacheConfig {
+  uint32_t blockSize;   /* in bytes, power of two */
+  uint64_t dramSize;    /* in bytes, 0 = whole 64 bit address space */
+  uint32_t cores;       /* private L1s, kept coherent with MESI */
+  uint32_t levels;      /* cache levels: the L1s, then levels - 1 shared ones */
+  LevelConfig level[MAX_LEVELS];  /* level[0] is L1, level[1] L2, ... */
+  uint32_t victimEntries; /* fully associative victim cache per L1, 0 = none */
+  uint32_t victimTime;    /* swap on a victim cache hit */
+  uint32_t inclusion;   /* InclusionPolicy, of L2 towards the L1s */
+
+  uint32_t dramReadTime;   /* dram_model = flat */
+  uint32_t dramWriteTime;
+  uint32_t dramModel;      /* DramModel */
+  uint32_t dramChannels;   /* dram_model = banked: power of two each */
+  uint32_t dramRanks;
+  uint32_t dramBanks;      /* per rank */
+  uint32_t dramRowSize;    /* in bytes, per bank */
+  uint32_t dramPage;       /* PagePolicy */
+  uint32_t dramMapping;    /* AddressMapping */
+  uint32_t dramRowHit;
+  uint32_t dramRowMiss;
+  uint32_t dramRowConflict;
+  uint32_t dramBurst;      /* data bus cycles per access */
+  uint32_t dramQueue;      /* FR-FCFS queue entries */
+
+  uint32_t seed;        /* random replacement seed */
+
+  uint32_t timing;      /* TimingModel */
+
+  uint32_t timingOnly;  /* 1: track tags only, no block data or DRAM contents */
+  uint32_t classifyMisses; /* 1: split misses into compulsory/capacity/conflict */
+  uint32_t warmup;      /* first accesses only fast-forwarded: tags, no timing */
+  uint32_t warmupMark;  /* 1: fast-forward until the first mark of the trace */
+} CacheConfig;
+
+void defaultConfig(CacheConfig *);
+
+int setConfigOption(CacheConfig *, const char *);
+
+int loadConfig(CacheConfig *, const char *);
+
+int checkConfig(const CacheConfig *);
+
+void printConfig(FILE *, const CacheConfig *);
+
+/***************** Address manipulation **************/
+
+/* Shifts and masks of one cache level, precomputed from its size. */
+typedef struct Geometry {
+  uint32_t sets;
+  uint32_t ways;
+  uint32_t blockSize;
+  uint32_t offsetBits;
+  uint32_t indexBits;
+  uint32_t tagShift;    /* offsetBits + indexBits */
+  uint32_t offsetMask;
+  uint32_t indexMask;
+} Geometry;
+
+void makeGeometry(Geometry *, uint32_t, uint32_t, uint32_t);
+
+static inline uint32_t getOffset(const Geometry *geometry, uint64_t address) {
+  return (uint32_t)address & geometry->offsetMask;
+}
+
+static inline uint32_t getIndex(const Geometry *geometry, uint64_t address) {
+  return (uint32_t)(address >> geometry->offsetBits) & geometry->indexMask;
+}
+
+static inline uint64_t getTag(const Geometry *geometry, uint64_t address) {
+  return address >> geometry->tagShift;
+}
+
+/* Address of the first byte of the block. */
+static inline uint64_t getMemAddress(const Geometry *geometry, uint64_t address) {
+  return address & ~(uint64_t)geometry->offsetMask;
+}
+
+/* Rebuilds a block address from the tag and set it is stored in. */
+static inline uint64_t getBlockAddress(const Geometry *geometry, uint64_t tag, uint32_t index) {
+  return (tag << geometry->tagShift) | ((uint64_t)index << geometry->offsetBits);
+}
+
+#endif
@@ -0,0 +1,252 @@
+/*******************************************************************************
+*                                                                              *
+*                      Banked DRAM timing                                      *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Timing of DRAM with dram_model = banked, instead of one constant per read
+and per write. Memory is split in channels, ranks and banks, each bank with
+a row buffer; dram_mapping decides which address bits pick each of them.
+
+An access to the row open in its bank is a row hit (dram_row_hit), to a
+precharged bank a row miss (dram_row_miss, activate first), and to a bank
+with another row open a row conflict (dram_row_conflict, precharge too).
+With dram_page = closed the row is closed after every access, so there are
+only row misses. A bank is held while it precharges and activates a row,
+then accesses to the open row follow each other every dram_burst cycles;
+the channel's data bus is busy for dram_burst cycles at the end of each.
+
+Requests go through an FR-FCFS queue of dram_queue entries: among the ones
+that have arrived, row hits are served first, then the oldest. Reads are
+blocking, so the queue holds the posted writes plus the read being served;
+a read may pass older writes that would conflict with it, or wait behind
+writes to its open row. The contents of memory live in Memory.c.
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "Cache.h"
+#include "Dram.h"
+
+const char *const DramModelNames[] = {"flat", "banked", NULL};
+const char *const PagePolicyNames[] = {"open", "closed", NULL};
+const char *const AddressMappingNames[] = {"row_bank_col", "row_col_bank", "xor", NULL};
+
+static uint32_t log2u(uint32_t value) {
+  uint32_t bits = 0;
+  while ((1u << bits) < value)
+    bits++;
+  return bits;
+}
+
+/*------------------------------------------------------------------------------
+The config must have passed checkConfig. Returns 0 on success, -1 if out of
+memory.
+------------------------------------------------------------------------------*/
+int initDram(DramController *d, const CacheConfig *config) {
+
+  memset(d, 0, sizeof(*d));
+  d->channels = config->dramChannels;
+  d->ranks = config->dramRanks;
+  d->banks = config->dramBanks;
+  d->channelBits = log2u(d->channels);
+  d->rankBits = log2u(d->ranks);
+  d->bankBits = log2u(d->banks);
+  d->columnBits = log2u(config->dramRowSize);
+  d->blockBits = log2u(config->blockSize);
+  d->page = config->dramPage;
+  d->mapping = config->dramMapping;
+  d->rowHit = config->dramRowHit;
+  d->rowMiss = config->dramRowMiss;
+  d->rowConflict = config->dramRowConflict;
+  d->burst = config->dramBurst;
+  d->capacity = config->dramQueue;
+
+  d->bank = malloc((size_t)d->channels * d->ranks * d->banks * sizeof(DramBank));
+  d->busFree = malloc(d->channels * sizeof(uint64_t));
+  if (!d->bank || !d->busFree) {
+    freeDram(d);
+    return -1;
+  }
+
+  resetDram(d);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Every bank precharged and idle, no request queued.
+------------------------------------------------------------------------------*/
+void resetDram(DramController *d) {
+  for (uint32_t i = 0; i < d->channels * d->ranks * d->banks; i++) {
+    d->bank[i].openRow = NO_ROW;
+    d->bank[i].ready = 0;
+  }
+  memset(d->busFree, 0, d->channels * sizeof(uint64_t));
+  d->count = 0;
+}
+
+void freeDram(DramController *d) {
+  free(d->bank);
+  free(d->busFree);
+  memset(d, 0, sizeof(*d));
+}
+
+/*------------------------------------------------------------------------------
+Channel, bank (index into d->bank) and row of address, per dram_mapping.
+------------------------------------------------------------------------------*/
+static void mapAddress(const DramController *d, uint64_t address, DramRequest *request) {
+
+  uint32_t channel, rank, bank;
+  uint64_t bits;
+
+  if (d->mapping == MAP_ROW_COL_BANK) {
+    bits = address >> d->blockBits;
+    channel = (uint32_t)bits & (d->channels - 1);
+    bits >>= d->channelBits;
+    bank = (uint32_t)bits & (d->banks - 1);
+    bits >>= d->bankBits;
+    rank = (uint32_t)bits & (d->ranks - 1);
+    bits >>= d->rankBits;
+    request->row = bits >> (d->columnBits - d->blockBits);
+  }
+  else {
+    bits = address >> d->columnBits;
+    channel = (uint32_t)bits & (d->channels - 1);
+    bits >>= d->channelBits;
+    bank = (uint32_t)bits & (d->banks - 1);
+    bits >>= d->bankBits;
+    rank = (uint32_t)bits & (d->ranks - 1);
+    bits >>= d->rankBits;
+    request->row = bits;
+    if (d->mapping == MAP_XOR) // rows that would hit one bank spread over all
+      bank ^= (uint32_t)bits & (d->banks - 1);
+  }
+
+  request->channel = channel;
+  request->bank = (channel * d->ranks + rank) * d->banks + bank;
+}
+
+/*------------------------------------------------------------------------------
+Position of the request FR-FCFS serves next among those arrived by now: the
+oldest row hit, else the oldest; if none has arrived yet, the first to
+arrive. The queue must not be empty.
+------------------------------------------------------------------------------*/
+static uint32_t pickRequest(const DramController *d, uint64_t now) {
+
+  int oldest = -1;
+  uint32_t first = 0;
+
+  for (uint32_t i = 0; i < d->count; i++) {
+    const DramRequest *request = &d->queue[i];
+    if (request->arrival < d->queue[first].arrival)
+      first = i;
+    if (request->arrival > now)
+      continue;
+    if (d->bank[request->bank].openRow == request->row)
+      return i;
+    if (oldest < 0)
+      oldest = (int)i;
+  }
+  return oldest >= 0 ? (uint32_t)oldest : first;
+}
+
+/*------------------------------------------------------------------------------
+Serves the queued request at position, no earlier than now. Returns when its
+data has crossed the bus.
+------------------------------------------------------------------------------*/
+static uint64_t serveRequest(DramController *d, DramStats *stats, uint32_t position,
+                             uint64_t now) {
+
+  DramRequest request = d->queue[position];
+  DramBank *bank = &d->bank[request.bank];
+  uint64_t start = now > request.arrival ? now : request.arrival;
+  uint32_t latency;
+
+  if (bank->ready > start)
+    start = bank->ready;
+
+  if (bank->openRow == request.row) {
+    latency = d->rowHit;
+    stats->rowHits++;
+  }
+  else if (bank->openRow == NO_ROW) {
+    latency = d->rowMiss;
+    stats->rowMisses++;
+  }
+  else {
+    latency = d->rowConflict;
+    stats->rowConflicts++;
+  }
+
+  uint64_t done = start + latency;
+  if (d->busFree[request.channel] + d->burst > done)
+    done = d->busFree[request.channel] + d->burst;
+
+  // column accesses to an open row pipeline: the bank is only held while
+  // it precharges and activates, then for one burst
+  d->busFree[request.channel] = done;
+  bank->ready = start + (latency - d->rowHit) + d->burst;
+  bank->openRow = d->page == PAGE_OPEN ? request.row : NO_ROW;
+
+  d->count--;
+  memmove(&d->queue[position], &d->queue[position + 1],
+          (d->count - position) * sizeof(DramRequest));
+  return done;
+}
+
+static void queueRequest(DramController *d, uint64_t address, uint64_t arrival, uint32_t mode) {
+
+  DramRequest *request = &d->queue[d->count++];
+
+  mapAddress(d, address, request);
+  request->arrival = arrival;
+  request->mode = mode;
+}
+
+/*------------------------------------------------------------------------------
+Read of the block at address arriving at time now. Requests are served
+until it is; returns when its data arrives.
+------------------------------------------------------------------------------*/
+uint64_t readDram(DramController *d, DramStats *stats, uint64_t address, uint64_t now) {
+
+  if (d->count == d->capacity) // room for the read
+    serveRequest(d, stats, pickRequest(d, now), now);
+  queueRequest(d, address, now, MODE_READ);
+
+  for (;;) {
+    uint32_t position = pickRequest(d, now);
+    int read = d->queue[position].mode == MODE_READ;
+    uint64_t done = serveRequest(d, stats, position, now);
+    if (read)
+      return done;
+  }
+}
+
+/*------------------------------------------------------------------------------
+Posts a write arriving at time now. Returns when the queue took it: right
+away, or once a request was served to make room.
+------------------------------------------------------------------------------*/
+uint64_t writeDram(DramController *d, DramStats *stats, uint64_t address, uint64_t now) {
+
+  if (d->count == d->capacity) {
+    uint64_t done = serveRequest(d, stats, pickRequest(d, now), now);
+    now = done > now ? done : now;
+  }
+  queueRequest(d, address, now, MODE_WRITE);
+  return now;
+}
+
+/*------------------------------------------------------------------------------
+Serves every queued write. Returns when the last one is done.
+------------------------------------------------------------------------------*/
+uint64_t drainDram(DramController *d, DramStats *stats, uint64_t now) {
+
+  uint64_t last = now;
+
+  while (d->count) {
+    uint64_t done = serveRequest(d, stats, pickRequest(d, now), now);
+    last = done > last ? done : last;
+  }
+  return last;
+}
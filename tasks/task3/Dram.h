@@ -0,0 +1,76 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdint.h>
+#include "Config.h"
+#include "Stats.h"
+
+#define MAX_DRAM_BANKS 1024   // channels * ranks * banks
+#define MAX_DRAM_QUEUE 64     // requests waiting in the controller
+#define NO_ROW UINT64_MAX
+
+typedef enum DramModel {
+  DRAM_FLAT,     /* dram_read_time / dram_write_time for every access */
+  DRAM_BANKED    /* DramController below */
+} DramModel;
+
+typedef enum PagePolicy {
+  PAGE_OPEN,     /* a row stays open after an access */
+  PAGE_CLOSED    /* ... is closed (precharged) right away */
+} PagePolicy;
+
+typedef enum AddressMapping {
+  MAP_ROW_BANK_COL,   /* row | rank | bank | channel | column: blocks of a row together */
+  MAP_ROW_COL_BANK,   /* row | column | rank | bank | channel | block: blocks interleaved */
+  MAP_XOR             /* row_bank_col with the bank bits xored with the low row bits */
+} AddressMapping;
+
+extern const char *const DramModelNames[];
+extern const char *const PagePolicyNames[];
+extern const char *const AddressMappingNames[];
+
+typedef struct DramBank {
+  uint64_t openRow;   /* NO_ROW when precharged */
+  uint64_t ready;     /* when its current access ends */
+} DramBank;
+
+typedef struct DramRequest {
+  uint64_t arrival;
+  uint64_t row;
+  uint32_t bank;      /* index in DramController.banks */
+  uint32_t channel;
+  uint32_t mode;      /* MODE_READ or MODE_WRITE */
+} DramRequest;
+
+/* Banked DRAM behind an FR-FCFS request queue. Reads are answered when
+   served; writes are posted and wait in the queue until a read, a full
+   queue or a drain has them served. Queue entries are kept oldest first. */
+typedef struct DramController {
+  uint32_t channels, ranks, banks;   /* banks per rank */
+  uint32_t channelBits, rankBits, bankBits;
+  uint32_t columnBits;               /* log2 of the row size */
+  uint32_t blockBits;                /* log2 of the interleaving unit (row_col_bank) */
+  PagePolicy page;
+  AddressMapping mapping;
+  uint32_t rowHit, rowMiss, rowConflict, burst;
+
+  DramBank *bank;
+  uint64_t *busFree;                 /* per channel: when its data bus is free */
+  DramRequest queue[MAX_DRAM_QUEUE];
+  uint32_t count;
+  uint32_t capacity;
+} DramController;
+
+int initDram(DramController *, const CacheConfig *);
+
+void resetDram(DramController *);
+
+void freeDram(DramController *);
+
+uint64_t readDram(DramController *, DramStats *, uint64_t, uint64_t);
+
+uint64_t writeDram(DramController *, DramStats *, uint64_t, uint64_t);
+
+uint64_t drainDram(DramController *, DramStats *, uint64_t);
+
+#endif
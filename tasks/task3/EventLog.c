@@ -0,0 +1,172 @@
+/*******************************************************************************
+*                                                                              *
+*                      Binary event log                                        *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Records what a run does (the drivers' sections and, depending on the level,
+the accesses that miss in L1 or all of them) as fixed size binary records
+instead of one formatted line per access.
+
+The simulator copies each record into a ring buffer and goes on; a flush
+thread waits for EVENT_LOG_CHUNK records and writes whatever the ring holds
+with one fwrite, so formatting and I/O leave the simulation thread. The ring
+has one producer and one consumer, with the counts of records logged and
+written as atomics; the mutex and condition variables are only taken to
+sleep and wake up. logdecode renders a log as the drivers' text output.
+------------------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "EventLog.h"
+
+const char *const LogLevelNames[] = {"none", "marks", "misses", "accesses", NULL};
+
+
+
+/*******************************************************************************
+Flush thread
+*******************************************************************************/
+
+/* Writes the records from tail to head, in at most two runs of the ring. */
+static void writeRecords(EventLog *log, uint64_t tail, uint64_t head) {
+  while (tail < head) {
+    uint64_t slot = tail & (EVENT_LOG_RING - 1);
+    size_t count = (size_t)(head - tail);
+    if (count > EVENT_LOG_RING - slot)
+      count = (size_t)(EVENT_LOG_RING - slot);
+    if (fwrite(&log->ring[slot], sizeof(EventRecord), count, log->out) != count)
+      log->error = 1;
+    tail += count;
+  }
+}
+
+static void *flushEventLog(void *argument) {
+
+  EventLog *log = argument;
+  int closing = 0;
+
+  pthread_mutex_lock(&log->lock);
+  while (!closing) {
+    uint64_t tail = atomic_load_explicit(&log->tail, memory_order_relaxed);
+
+    while (!log->closing &&
+           atomic_load_explicit(&log->head, memory_order_acquire) - tail < EVENT_LOG_CHUNK)
+      pthread_cond_wait(&log->filled, &log->lock);
+    closing = log->closing;
+    pthread_mutex_unlock(&log->lock);
+
+    // the simulator only adds past head, so this part is ours to write
+    uint64_t head = atomic_load_explicit(&log->head, memory_order_acquire);
+    writeRecords(log, tail, head);
+    atomic_store_explicit(&log->tail, head, memory_order_release);
+
+    pthread_mutex_lock(&log->lock);
+    pthread_cond_broadcast(&log->drained);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return NULL;
+}
+
+
+
+/*******************************************************************************
+Interface
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Creates the log file at path, recording events up to level, and starts its
+flush thread. Returns 0 on success, -1 on error (errno is set).
+------------------------------------------------------------------------------*/
+int openEventLog(EventLog *log, const char *path, uint32_t level) {
+
+  EventLogHeader header;
+
+  memset(log, 0, sizeof(*log));
+  log->level = level;
+  log->ring = malloc(EVENT_LOG_RING * sizeof(EventRecord));
+  log->out = fopen(path, "wb");
+  if (!log->ring || !log->out) {
+    free(log->ring);
+    if (log->out)
+      fclose(log->out);
+    return -1;
+  }
+
+  memcpy(header.magic, EVENT_LOG_MAGIC, 8);
+  header.version = EVENT_LOG_VERSION;
+  header.recordSize = sizeof(EventRecord);
+  if (fwrite(&header, sizeof(header), 1, log->out) != 1)
+    log->error = 1;
+
+  atomic_init(&log->head, 0);
+  atomic_init(&log->tail, 0);
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->filled, NULL);
+  pthread_cond_init(&log->drained, NULL);
+  errno = pthread_create(&log->flusher, NULL, flushEventLog, log);
+  if (errno) {
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->filled);
+    pthread_cond_destroy(&log->drained);
+    fclose(log->out);
+    free(log->ring);
+    return -1;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Writes out what the ring still holds, stops the flush thread and closes the
+file. Returns 0, or -1 if a write failed along the way.
+------------------------------------------------------------------------------*/
+int closeEventLog(EventLog *log) {
+
+  pthread_mutex_lock(&log->lock);
+  log->closing = 1;
+  pthread_cond_signal(&log->filled);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->flusher, NULL);
+
+  if (fclose(log->out) != 0)
+    log->error = 1;
+  pthread_mutex_destroy(&log->lock);
+  pthread_cond_destroy(&log->filled);
+  pthread_cond_destroy(&log->drained);
+  free(log->ring);
+  log->ring = NULL;
+  return log->error ? -1 : 0;
+}
+
+/* The ring is full: hurries the flush thread and waits for it. */
+void waitEventLog(EventLog *log) {
+
+  uint64_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+
+  pthread_mutex_lock(&log->lock);
+  pthread_cond_signal(&log->filled);
+  while (head - atomic_load_explicit(&log->tail, memory_order_acquire) == EVENT_LOG_RING)
+    pthread_cond_wait(&log->drained, &log->lock);
+  pthread_mutex_unlock(&log->lock);
+}
+
+/* Another chunk is ready for the flush thread. */
+void wakeEventLog(EventLog *log) {
+  pthread_mutex_lock(&log->lock);
+  pthread_cond_signal(&log->filled);
+  pthread_mutex_unlock(&log->lock);
+}
+
+/*------------------------------------------------------------------------------
+Records the start of a section of a driver (a LogMark and its argument) at
+time, from level LOG_MARKS up.
+------------------------------------------------------------------------------*/
+void logMark(EventLog *log, uint32_t mark, uint64_t argument, uint64_t time) {
+
+  EventRecord record = {time, argument, mark, EVENT_MARK, 0, 0, 0};
+
+  if (log->level >= LOG_MARKS)
+    logEvent(log, &record);
+}
@@ -0,0 +1,90 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define EVENT_LOG_MAGIC "OC1EVLOG"
+#define EVENT_LOG_VERSION 1
+#define EVENT_LOG_RING (1u << 16)   // records between the simulator and the flush thread
+#define EVENT_LOG_CHUNK 4096        // records the flush thread waits for before a write
+
+typedef enum LogLevel {
+  LOG_NONE,      /* nothing is recorded */
+  LOG_MARKS,     /* the sections the drivers mark */
+  LOG_MISSES,    /* ... and the accesses that missed in L1 */
+  LOG_ACCESSES   /* ... and every access */
+} LogLevel;
+
+extern const char *const LogLevelNames[];
+
+/* Sections of the SimpleProgram drivers, rendered by logdecode. */
+typedef enum LogMark {
+  MARK_WORDS,    /* "Number of words: <argument>" */
+  MARK_RANDOM,   /* "Random accesses" */
+  MARK_TRACE     /* a mark of a replayed trace, "M <argument>" */
+} LogMark;
+
+#define EVENT_MARK 2   // kind of a mark record; accesses have their MODE_*
+#define EVENT_MISS 1   // flag: the access missed in L1
+
+/* On-disk layout of an event log (little endian): an EventLogHeader, then
+   fixed size EventRecords. */
+typedef struct EventLogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+} EventLogHeader;
+
+typedef struct EventRecord {
+  uint64_t time;      /* hierarchy time once the access is done */
+  uint64_t address;   /* marks: their argument */
+  uint32_t value;     /* first bytes of the data read or written; marks: LogMark */
+  uint8_t kind;       /* MODE_READ, MODE_WRITE or EVENT_MARK */
+  uint8_t core;
+  uint8_t size;       /* bytes accessed */
+  uint8_t flags;      /* EVENT_MISS */
+} EventRecord;
+
+/* Records go into a ring that a background thread drains to the file: the
+   simulator only waits when the ring is full. */
+typedef struct EventLog {
+  FILE *out;
+  uint32_t level;          /* LogLevel */
+  EventRecord *ring;       /* EVENT_LOG_RING records */
+  _Atomic uint64_t head;   /* records logged so far */
+  _Atomic uint64_t tail;   /* ... and written out */
+  pthread_t flusher;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;   /* a chunk is waiting, or the log closes */
+  pthread_cond_t drained;  /* the ring has room again */
+  int closing;
+  int error;               /* a write failed */
+} EventLog;
+
+int openEventLog(EventLog *, const char *, uint32_t);
+
+int closeEventLog(EventLog *);
+
+void waitEventLog(EventLog *);
+
+void wakeEventLog(EventLog *);
+
+/* Appends a record; the caller has checked the level. */
+static inline void logEvent(EventLog *log, const EventRecord *record) {
+
+  uint64_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+
+  if (head - atomic_load_explicit(&log->tail, memory_order_acquire) == EVENT_LOG_RING)
+    waitEventLog(log);
+  log->ring[head & (EVENT_LOG_RING - 1)] = *record;
+  atomic_store_explicit(&log->head, head + 1, memory_order_release);
+  if ((head + 1) % EVENT_LOG_CHUNK == 0)
+    wakeEventLog(log);
+}
+
+void logMark(EventLog *, uint32_t, uint64_t, uint64_t);
+
+#endif
@@ -8,294 +8,1951 @@
 Contém 2 entradas em cada set
 O número do bloco determina o set
 Procura todas as entradas de um determinado set de uma vez
-N comparadores 
-
+N comparadores
+
+Sizes, ways and latencies come from the runtime CacheConfig (defaults in
+Cache.h); index, tag and offset use the shifts and masks precomputed in each
+level's Geometry.
+
+Below the private L1s come config.levels - 1 shared levels (L2, L3, ...).
+They are all the same Cache, chained through its next pointer down to the
+last one, in front of DRAM, and accessed by the one accessLevel: adding a
+level is a matter of configuration. A hit never leaves its level, and a miss
+goes on to the next one with a direct call.
+
+Each level stores its sets as parallel arrays (tags, dirty bits, LRU stamps,
+blocks) with an empty way marked by INVALID_TAG, so probing a set reads one
+contiguous run of tags, compared with SSE2/AVX2 when the host has them.
+
+Addresses and tags are 64 bit. DRAM is a sparse BackingStore (Memory.c), so
+traces can use their own addresses; dram_size only adds a bound check. Its
+timing is flat, or with dram_model = banked that of banks with row buffers
+behind an FR-FCFS queue (Dram.c), where writes are posted.
+
+Every level counts reads, writes, hits, misses, fills and evictions in its
+LevelStats, and DRAM its transfers (Stats.c exports them). With
+classify_misses set, misses also go through a shadow fully associative
+cache to be split into compulsory, capacity and conflict.
+
+With timing_only set, lines keep only valid/dirty/tag/LRU state: no block
+data or DRAM is allocated and no block is copied, reads return 0.
+
+Each level is write-back or write-through, and allocates on write misses or
+sends them down without a fill (l1_write/l1_allocate, ...). Writes leaving a
+level go straight to the next one, or, with a write buffer, into a queue that
+coalesces writes per block and drains in the background: a drain starts when
+the previous one ends and takes the time the next level needs, and only a
+full buffer or a read of a queued block makes the program wait for it.
+
+An L1 may have a victim cache: a one set Cache holding the lines the L1
+evicted. A miss that hits there swaps the two lines (victim_time) instead of
+going to L2, and only lines leaving the victim cache are written back.
+
+Each level may have a prefetcher (Prefetch.c) trained on its demand accesses.
+Its fills run in the background one after the other, like write buffer
+drains; a demand hit on a prefetched line whose fill has not ended yet waits
+for it (a late prefetch), and the blocks that prefetches evict are remembered
+to count the misses they cause (polluting prefetches).
+
+With timing = event the caches are non-blocking: each core has its own clock
+and keeps issuing past its misses, which hold an MSHR of their level until
+their fill arrives, merge when they are to a block already being filled and
+overlap up to the MSHR limits (Timing.c). The accesses themselves still run
+one by one, in trace order, as in the serial model; only their timing is
+scheduled, from the latencies and misses they went through.
+
+L2 is neither inclusive nor exclusive of the L1s (inclusion = nine): it
+keeps the blocks it fetched for them, whether they are still above or not.
+An inclusive L2 back-invalidates the L1 copies of the blocks it evicts; an
+exclusive one gives its blocks away to the L1 fills and takes in every L1
+victim instead, so that together they hold more distinct blocks.
+
+A Hierarchy may log its accesses to an EventLog (EventLog.c): every one, or
+only those that missed in L1, as binary records the log writes out from its
+own thread.
+
+With warmup (or warmup_mark) set, the first accesses of a run only
+fast-forward it: the hierarchy sets its block data, write buffers,
+prefetchers, timing and DRAM models aside, so the accesses go through the
+same paths, timing_only style, updating tags, dirty and MESI bits and
+replacement state alone; written values go straight to the backing store
+and reads return zeros.
+When warmup accesses have passed (or the trace marks the end), every line
+takes its data back from the store, the clock goes back to where it was and
+the counters start from zero.
+
+With cores > 1 every core has a private L1 and the L1s are kept coherent
+with MESI by snooping each other on misses and upgrades: dirty is M, and a
+shared bit per line tells S from E. Accesses carry the core that issues
+them.
+
+All state (DRAM, time and every level) lives in a Hierarchy passed to every access
+function, so independent hierarchies can run side by side in one process.
+read()/write() and the other argument-less functions drive a default
+hierarchy, for the single threaded drivers.
 ------------------------------------------------------------------------------*/
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "L2Cache2w.h"
 
-uint8_t DRAM[DRAM_SIZE];
-uint32_t time;
+static Hierarchy *Default;
+
+static void initLevel(Cache *);
+static int snoopL1(Hierarchy *, uint32_t, uint64_t, int);
+static void evictToVictim(Hierarchy *, Cache *, size_t, uint32_t);
+static uint8_t fillL1(Hierarchy *, uint64_t, uint8_t *, int);
+static void evictL1(Hierarchy *, Cache *, uint64_t, uint8_t *, uint8_t);
+static void backInvalidate(Hierarchy *, Cache *, size_t, uint64_t);
+static void fastForward(Hierarchy *, uint32_t, uint64_t, uint8_t *, uint32_t, uint32_t);
+static void restoreDetail(Hierarchy *);
 
-CacheL1 L1Cache;
-CacheL2 L2Cache;
 
 
 /*******************************************************************************
-Time Manipulation 
+DRAM memory (byte addressable)
 *******************************************************************************/
-void resetTime() { time = 0; }
 
-uint32_t getTime() { return time; }
+/*------------------------------------------------------------------------------
+Access DRAM (last cache level <-> DRAM).
+------------------------------------------------------------------------------*/
+void accessDRAM(Hierarchy *h, uint64_t address, uint8_t *data, uint32_t size, uint32_t mode) {
+
+  // with timing = event a demand access waits for DRAM only from its fill,
+  // in scheduleFill; its other DRAM accesses just keep the banks busy
+  int foreground = h->timing && !h->timing->background;
+
+  if (h->config.dramSize && address > h->config.dramSize - size)
+    exit(-1);
+
+  if (mode == MODE_READ) {
+    if (h->dram)
+      readMemory(h->dram, address, data, size);
+    if (!h->controller || (foreground && h->timing->fill))
+      h->time += h->config.dramReadTime;
+    else {
+      uint64_t done = readDram(h->controller, &h->dramStats, address, h->time);
+      h->time = foreground ? h->time + h->config.dramReadTime : done;
+    }
+    h->dramStats.reads++;
+    h->dramStats.readBytes += size;
+  }
+
+  if (mode == MODE_WRITE) {
+    if (h->dram && data)
+      writeMemory(h->dram, address, data, size);
+    if (!h->controller)
+      h->time += h->config.dramWriteTime;
+    else {
+      uint64_t accepted = writeDram(h->controller, &h->dramStats, address, h->time);
+      h->time = foreground ? h->time : accepted;
+    }
+    h->dramStats.writes++;
+    h->dramStats.writeBytes += size;
+  }
+}
 
 
 
 /*******************************************************************************
-DRAM memory (byte addressable) 
+Hierarchy life cycle
 *******************************************************************************/
 
+static int allocateLevel(Cache *cache, uint32_t size, uint32_t ways, uint32_t blockSize,
+                         uint32_t readTime, uint32_t writeTime, uint32_t policy,
+                         uint32_t seed, uint32_t timingOnly, uint32_t classify) {
+
+  makeGeometry(&cache->geometry, size, ways, blockSize);
+  cache->readTime = readTime;
+  cache->writeTime = writeTime;
+  size_t lines = (size_t)cache->geometry.sets * ways;
+  // one set of 8 tags fills a host cache line
+  cache->tags = aligned_alloc(64, (lines * sizeof(uint64_t) + 63) & ~(size_t)63);
+  cache->dirty = calloc(lines, 1);
+  cache->data = timingOnly ? NULL : calloc(size, 1);
+  cache->classifier = classify ? malloc(sizeof(Classifier)) : NULL;
+
+  if (!cache->tags || !cache->dirty || (!timingOnly && !cache->data) ||
+      initReplacement(&cache->repl, policy, cache->geometry.sets, ways, seed) < 0)
+    return -1;
+
+  if (classify && (!cache->classifier || initClassifier(cache->classifier, (uint32_t)lines) < 0)) {
+    free(cache->classifier);
+    cache->classifier = NULL;
+    return -1;
+  }
+
+  initLevel(cache);
+  return 0;
+}
+
 /*------------------------------------------------------------------------------
-Access DRAM (L2 Cache <-> DRAM).
+MESI state beyond dirty (= M) for the L1s of a multicore hierarchy.
 ------------------------------------------------------------------------------*/
-void accessDRAM(uint32_t address, uint8_t *data, uint32_t mode) {
+static int allocateCoherence(Cache *cache) {
 
-  if (address >= DRAM_SIZE - WORD_SIZE + 1)
-    exit(-1);
+  size_t lines = (size_t)cache->geometry.sets * cache->geometry.ways;
 
-  if (mode == MODE_READ) {
-    memcpy(data, &(DRAM[address]), BLOCK_SIZE);
-    time += DRAM_READ_TIME;
+  cache->shared = calloc(lines, 1);
+  cache->stale = malloc(lines * sizeof(uint64_t));
+  if (!cache->shared || !cache->stale)
+    return -1;
+
+  memset(cache->stale, 0xFF, lines * sizeof(uint64_t));
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Write policy of a level, and its write buffer if entries > 0.
+------------------------------------------------------------------------------*/
+static int setupWrites(Cache *cache, uint32_t policy, uint32_t allocate, uint32_t entries,
+                       uint32_t timingOnly) {
+
+  cache->writeThrough = policy == WRITE_THROUGH;
+  cache->writeAllocate = allocate;
+  if (!entries)
+    return 0;
+
+  cache->buffer = malloc(sizeof(WriteBuffer));
+  if (!cache->buffer)
+    return -1;
+  if (initWriteBuffer(cache->buffer, entries, cache->geometry.blockSize, !timingOnly) < 0) {
+    free(cache->buffer);
+    cache->buffer = NULL;
+    return -1;
   }
+  return 0;
+}
 
-  if (mode == MODE_WRITE) {
-    memcpy(&(DRAM[address]), data, BLOCK_SIZE);
-    time += DRAM_WRITE_TIME;
+/*------------------------------------------------------------------------------
+Victim cache behind an L1: fully associative (one set), LRU.
+------------------------------------------------------------------------------*/
+static int allocateVictim(Cache *cache, const CacheConfig *config) {
+
+  Cache *victim = calloc(1, sizeof(Cache));
+
+  cache->victim = victim;
+  if (!victim ||
+      allocateLevel(victim, config->victimEntries * config->blockSize, config->victimEntries,
+                    config->blockSize, config->victimTime, config->victimTime, REPL_LRU,
+                    config->seed, config->timingOnly, 0) < 0 ||
+      (config->cores > 1 && allocateCoherence(victim) < 0))
+    return -1;
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Prefetcher of a level, unless policy is PREFETCH_NONE.
+------------------------------------------------------------------------------*/
+static int allocatePrefetch(Cache *cache, uint32_t policy, uint32_t degree) {
+
+  size_t lines = (size_t)cache->geometry.sets * cache->geometry.ways;
+
+  if (policy == PREFETCH_NONE)
+    return 0;
+
+  cache->prefetcher = malloc(sizeof(Prefetcher));
+  cache->prefetched = calloc(lines, 1);
+  cache->start = calloc(lines, sizeof(uint64_t));
+  cache->ready = calloc(lines, sizeof(uint64_t));
+  if (!cache->prefetcher || !cache->prefetched || !cache->start || !cache->ready)
+    return -1;
+
+  initPrefetcher(cache->prefetcher, policy, degree, cache->geometry.offsetBits);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Room to set the detail models aside while fast-forwarding, armed for the
+first warmup accesses (or until a mark).
+------------------------------------------------------------------------------*/
+static int allocateWarmup(Hierarchy *h) {
+
+  const CacheConfig *config = &h->config;
+  uint32_t caches = config->cores * (config->victimEntries ? 2 : 1) + config->levels - 1;
+  Warmup *w = calloc(1, sizeof(Warmup));
+
+  h->warm = w;
+  if (!w)
+    return -1;
+  w->length = config->warmup ? config->warmup : UINT64_MAX;
+  w->data = calloc(caches, sizeof(uint8_t *));
+  w->buffers = calloc(caches, sizeof(WriteBuffer *));
+  w->prefetchers = calloc(caches, sizeof(Prefetcher *));
+  h->warmup = w->length;
+  return w->data && w->buffers && w->prefetchers ? 0 : -1;
+}
+
+static void freeLevel(Cache *cache) {
+  if (cache->victim)
+    freeLevel(cache->victim);
+  free(cache->victim);
+  if (cache->buffer)
+    freeWriteBuffer(cache->buffer);
+  free(cache->buffer);
+  free(cache->tags);
+  free(cache->dirty);
+  free(cache->shared);
+  free(cache->stale);
+  free(cache->prefetcher);
+  free(cache->prefetched);
+  free(cache->start);
+  free(cache->ready);
+  freeReplacement(&cache->repl);
+  free(cache->data);
+  if (cache->classifier)
+    freeClassifier(cache->classifier);
+  free(cache->classifier);
+}
+
+/*------------------------------------------------------------------------------
+Builds a hierarchy with empty caches, zeroed DRAM and time 0.
+The config must have passed checkConfig. Returns NULL if out of memory.
+------------------------------------------------------------------------------*/
+Hierarchy *createHierarchy(const CacheConfig *config) {
+
+  Hierarchy *h = calloc(1, sizeof(Hierarchy));
+
+  if (!h)
+    return NULL;
+
+  h->config = *config;
+  if (!config->timingOnly) {
+    h->dram = malloc(sizeof(BackingStore));
+    if (h->dram && initMemory(h->dram) < 0) {
+      free(h->dram);
+      h->dram = NULL;
+    }
   }
+
+  h->l1 = calloc(config->cores, sizeof(Cache));
+  h->lower = calloc(config->levels - 1, sizeof(Cache));
+
+  if ((!config->timingOnly && !h->dram) || !h->l1 || !h->lower) {
+    destroyHierarchy(h);
+    return NULL;
+  }
+
+  // the cores' L1s have even seeds, from seed; L2, L3, ... seed + 1, + 3, ...
+  for (uint32_t i = 1; i < config->levels; i++) {
+    const LevelConfig *level = &config->level[i];
+    Cache *cache = &h->lower[i - 1];
+
+    cache->level = i + 1;
+    cache->next = i + 1 < config->levels ? cache + 1 : NULL;
+    if (allocateLevel(cache, level->size, level->ways, config->blockSize, level->readTime,
+                      level->writeTime, level->policy, config->seed + 2 * i - 1,
+                      config->timingOnly, config->classifyMisses) < 0 ||
+        setupWrites(cache, level->write, level->allocate, level->writeBuffer,
+                    config->timingOnly) < 0 ||
+        allocatePrefetch(cache, level->prefetch, level->prefetchDegree) < 0) {
+      destroyHierarchy(h);
+      return NULL;
+    }
+  }
+
+  if (config->dramModel == DRAM_BANKED) {
+    h->controller = malloc(sizeof(DramController));
+    if (!h->controller || initDram(h->controller, config) < 0) {
+      free(h->controller);
+      h->controller = NULL;
+      destroyHierarchy(h);
+      return NULL;
+    }
+  }
+
+  if (config->timing == TIMING_EVENT) {
+    uint32_t mshrs[MAX_LEVELS];
+    for (uint32_t i = 1; i < config->levels; i++)
+      mshrs[i - 1] = config->level[i].mshrs;
+    h->timing = malloc(sizeof(Timing));
+    if (!h->timing ||
+        initTiming(h->timing, config->cores, config->level[0].mshrs, mshrs, config->levels - 1) < 0) {
+      free(h->timing);
+      h->timing = NULL;
+      destroyHierarchy(h);
+      return NULL;
+    }
+  }
+
+  for (uint32_t core = 0; core < config->cores; core++) {
+    const LevelConfig *level = &config->level[0];
+
+    h->l1[core].level = 1;
+    h->l1[core].next = h->lower;
+    if (allocateLevel(&h->l1[core], level->size, level->ways, config->blockSize,
+                      level->readTime, level->writeTime, level->policy,
+                      config->seed + 2 * core, config->timingOnly, config->classifyMisses) < 0 ||
+        setupWrites(&h->l1[core], level->write, level->allocate, level->writeBuffer,
+                    config->timingOnly) < 0 ||
+        allocatePrefetch(&h->l1[core], level->prefetch, level->prefetchDegree) < 0 ||
+        (config->cores > 1 && allocateCoherence(&h->l1[core]) < 0) ||
+        (config->victimEntries && allocateVictim(&h->l1[core], config) < 0)) {
+      destroyHierarchy(h);
+      return NULL;
+    }
+  }
+
+  if ((config->warmup || config->warmupMark) && allocateWarmup(h) < 0) {
+    destroyHierarchy(h);
+    return NULL;
+  }
+
+  return h;
+}
+
+void destroyHierarchy(Hierarchy *h) {
+
+  if (!h)
+    return;
+
+  if (h->warm) {
+    restoreDetail(h);
+    free(h->warm->data);
+    free(h->warm->buffers);
+    free(h->warm->prefetchers);
+    free(h->warm);
+  }
+  for (uint32_t core = 0; h->l1 && core < h->config.cores; core++)
+    freeLevel(&h->l1[core]);
+  free(h->l1);
+  for (uint32_t i = 0; h->lower && i < h->config.levels - 1; i++)
+    freeLevel(&h->lower[i]);
+  free(h->lower);
+  if (h->timing)
+    freeTiming(h->timing);
+  free(h->timing);
+  if (h->controller)
+    freeDram(h->controller);
+  free(h->controller);
+  if (h->dram)
+    freeMemory(h->dram);
+  free(h->dram);
+  free(h);
+}
+
+/*------------------------------------------------------------------------------
+Back to the state right after createHierarchy (listener and log are kept),
+warmup armed again.
+------------------------------------------------------------------------------*/
+void resetHierarchy(Hierarchy *h) {
+  if (h->warm) {
+    restoreDetail(h);
+    h->warm->accesses = 0;
+    h->warmup = h->warm->length;
+  }
+  initCacheL1(h);
+  initCacheL2(h);
+  if (h->dram)
+    clearMemory(h->dram);
+  h->time = 0;
+  if (h->timing)
+    resetTiming(h->timing);
+  if (h->controller)
+    resetDram(h->controller);
+  clearStats(h);
+}
+
+/*------------------------------------------------------------------------------
+Zeroes every counter. Cache contents and miss classification history stay.
+------------------------------------------------------------------------------*/
+void clearStats(Hierarchy *h) {
+  for (uint32_t core = 0; core < h->config.cores; core++)
+    memset(&h->l1[core].stats, 0, sizeof(LevelStats));
+  for (uint32_t i = 0; i < h->config.levels - 1; i++)
+    memset(&h->lower[i].stats, 0, sizeof(LevelStats));
+  memset(&h->dramStats, 0, sizeof(DramStats));
+}
+
+/*------------------------------------------------------------------------------
+Installs a callback that sees the L1 miss stream (fills and write-backs),
+e.g. for stack distance profiling. NULL removes it.
+------------------------------------------------------------------------------*/
+void setL2Listener(Hierarchy *h, L2Listener listener, void *context) {
+  if (h->warm && h->warm->active)
+    h->warm->listener = listener;
+  else
+    h->listener = listener;
+  h->listenerContext = context;
+}
+
+/*------------------------------------------------------------------------------
+Logs the accesses of h to log, as far as its level goes. NULL stops logging;
+the caller opens and closes the log.
+------------------------------------------------------------------------------*/
+void setEventLog(Hierarchy *h, EventLog *log) {
+  if (h->warm && h->warm->active)
+    h->warm->log = log;
+  else
+    h->log = log;
 }
 
 
 
 /*******************************************************************************
-Address processing functions.
+ Set lookup and replacement (shared by every level)
 *******************************************************************************/
 
+static void initLevel(Cache *cache) {
+
+  size_t lines = (size_t)cache->geometry.sets * cache->geometry.ways;
+
+  memset(cache->tags, 0xFF, lines * sizeof(uint64_t)); // every way INVALID_TAG
+  memset(cache->dirty, 0, lines);
+  resetReplacement(&cache->repl);
+  if (cache->data)
+    memset(cache->data, 0, lines * cache->geometry.blockSize);
+  if (cache->classifier)
+    resetClassifier(cache->classifier);
+  if (cache->buffer)
+    clearWriteBuffer(cache->buffer);
+  if (cache->victim)
+    initLevel(cache->victim);
+  if (cache->shared) {
+    memset(cache->shared, 0, lines);
+    memset(cache->stale, 0xFF, lines * sizeof(uint64_t));
+  }
+  if (cache->prefetcher) {
+    resetPrefetcher(cache->prefetcher);
+    memset(cache->prefetched, 0, lines);
+    memset(cache->start, 0, lines * sizeof(uint64_t));
+    memset(cache->ready, 0, lines * sizeof(uint64_t));
+  }
+}
+
+static inline int findWayN(const uint64_t *tags, uint64_t Tag, uint32_t ways) {
+
+  uint32_t i = 0;
+
+#if defined(__AVX2__)
+  __m256i key4 = _mm256_set1_epi64x((long long)Tag);
+  for (; i + 4 <= ways; i += 4) {
+    __m256i group = _mm256_loadu_si256((const __m256i *)&tags[i]);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(group, key4)));
+    if (mask)
+      return (int)i + __builtin_ctz((unsigned)mask);
+  }
+#endif
+#if defined(__SSE2__)
+  // SSE2 has no 64 bit compare: both 32 bit halves must match
+  __m128i key2 = _mm_set1_epi64x((long long)Tag);
+  for (; i + 2 <= ways; i += 2) {
+    __m128i group = _mm_loadu_si128((const __m128i *)&tags[i]);
+    __m128i equal = _mm_cmpeq_epi32(group, key2);
+    equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(equal));
+    if (mask)
+      return (int)i + __builtin_ctz((unsigned)mask);
+  }
+#endif
+  for (; i < ways; i++) {
+    if (tags[i] == Tag)
+      return (int)i;
+  }
+  return -1;
+}
+
 /*------------------------------------------------------------------------------
-Extracts the block's offset (6 least significant bits).
-Block size = 16 * word size = 64 bytes = 2^6 bytes.
-Block offset = 6 bits.
+Returns the way of the set holding Tag, or -1 on a miss (INVALID_TAG finds
+an empty way). The common associativities get a constant trip count.
 ------------------------------------------------------------------------------*/
-uint32_t getOffset(uint32_t address){
-  return address & 0x3F;  // 0x3F = 0b 0000 0011 1111
+static inline int findWay(const Cache *cache, const uint64_t *tags, uint64_t Tag) {
+  switch (cache->geometry.ways) {
+    case 1: return findWayN(tags, Tag, 1);
+    case 2: return findWayN(tags, Tag, 2);
+    case 4: return findWayN(tags, Tag, 4);
+    case 8: return findWayN(tags, Tag, 8);
+    case 16: return findWayN(tags, Tag, 16);
+    default: return findWayN(tags, Tag, cache->geometry.ways);
+  }
 }
 
 /*------------------------------------------------------------------------------
-Returns line index (8 bits).
-Line size = 256 = 2^8.
-Line index = 8 bits.
+An invalid way if there is one, otherwise the level's replacement policy.
 ------------------------------------------------------------------------------*/
-uint32_t getIndex(uint32_t address){
-  return(address >> 6) & 0xFF; // 0xFF = 1111 1111
+static uint32_t chooseVictim(Cache *cache, const uint64_t *tags, uint32_t index) {
+
+  int empty = findWay(cache, tags, INVALID_TAG);
+
+  if (empty >= 0)
+    return (uint32_t)empty;
+  return chooseReplacement(&cache->repl, index);
 }
 
 /*------------------------------------------------------------------------------
-Extracts the tag, 18 (= 32 - 6 - 8) most significant bits of address.
+Counts one access to a level; the shadow cache only runs when enabled.
+Returns the kind of miss, MISS_HIT on hits or without classification.
 ------------------------------------------------------------------------------*/
-uint32_t getTag(uint32_t address){
-  return address >> 14; // removing the 14 (6 + 8) least significant bits
+static inline uint32_t countAccess(Cache *cache, uint64_t address, uint32_t mode, int hit) {
+
+  LevelStats *stats = &cache->stats;
+  uint32_t kind = MISS_HIT;
+
+  stats->reads += mode == MODE_READ;
+  stats->writes += mode == MODE_WRITE;
+  stats->hits += hit;
+  stats->misses += !hit;
+  if (cache->classifier) {
+    kind = classifyAccess(cache->classifier, address >> cache->geometry.offsetBits, (uint32_t)hit);
+    countMiss(stats, kind);
+  }
+  return kind;
+}
+
+/* 1 if cache has the block holding address. */
+static inline int holdsBlock(const Cache *cache, uint64_t address) {
+  const Geometry *geometry = &cache->geometry;
+  size_t set = (size_t)getIndex(geometry, address) * geometry->ways;
+  return findWay(cache, &cache->tags[set], getTag(geometry, address)) >= 0;
+}
+
+/* Shared levels, from L2 down, that miss the block at address before one
+   holds it. */
+static inline uint32_t missedLevels(const Hierarchy *h, uint64_t address) {
+
+  uint32_t missed = 0;
+
+  for (const Cache *cache = h->lower; cache && !holdsBlock(cache, address); cache = cache->next)
+    missed++;
+  return missed;
+}
+
+/* Block of a line, NULL in timing only mode. */
+static inline uint8_t *lineData(const Cache *cache, size_t line) {
+  if (!cache->data)
+    return NULL;
+  return &cache->data[line * cache->geometry.blockSize];
+}
+
+/* Valid lines of cache whose block is neither in a shared level from below
+   down nor (for an L1 or its victim cache) in the L1s of the cores before
+   core. */
+static uint64_t ownBlocks(const Hierarchy *h, const Cache *below, uint32_t core,
+                          const Cache *cache) {
+
+  const Geometry *geometry = &cache->geometry;
+  size_t lines = (size_t)geometry->sets * geometry->ways;
+  uint64_t count = 0;
+
+  for (size_t line = 0; line < lines; line++) {
+    if (cache->tags[line] == INVALID_TAG)
+      continue;
+    uint64_t address = getBlockAddress(geometry, cache->tags[line],
+                                       (uint32_t)(line / geometry->ways));
+    int held = 0;
+    for (const Cache *lower = below; lower && !held; lower = lower->next)
+      held = holdsBlock(lower, address);
+    for (uint32_t other = 0; other < core && !held; other++)
+      held = holdsBlock(&h->l1[other], address) ||
+             (h->l1[other].victim && holdsBlock(h->l1[other].victim, address));
+    count += !held;
+  }
+  return count;
 }
 
 /*------------------------------------------------------------------------------
-Removes the last 6 bits (offset).
+Distinct blocks held by the caches (every level, victim caches included):
+the effective capacity of the hierarchy, that of L2 when inclusive, up to
+the sum of L2 and the L1s when exclusive. Each block counts in the lowest
+level that holds it.
 ------------------------------------------------------------------------------*/
-uint32_t getMemAddress(uint32_t address){
-  return address - getOffset(address); 
-}
+uint64_t uniqueBlocks(const Hierarchy *h) {
 
+  uint64_t count = 0;
 
-void initCache() {
-  initCacheL1();
-  initCacheL2();
+  for (uint32_t i = 0; i < h->config.levels - 1; i++)
+    count += ownBlocks(h, h->lower[i].next, 0, &h->lower[i]);
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    count += ownBlocks(h, h->lower, core, &h->l1[core]);
+    if (h->l1[core].victim)
+      count += ownBlocks(h, h->lower, core, h->l1[core].victim);
+  }
+  return count;
 }
 
 
 
 /*******************************************************************************
- L1 cache 
+ Writes to the next level
 *******************************************************************************/
 
-/*------------------------------------------------------------------------------ 
-Initializes L1 Cache.
+/* The write itself, below cache: the next level, or DRAM below the last. */
+static void writeNext(Hierarchy *h, Cache *cache, uint64_t address, uint8_t *data, uint32_t size) {
+  if (cache->next)
+    accessLevel(h, cache->next, address, data, size, MODE_WRITE);
+  else
+    accessDRAM(h, address, data, size, MODE_WRITE);
+}
+
+/* Reads the block at address into block from below cache, as writeNext. */
+static void readNext(Hierarchy *h, Cache *cache, uint64_t address, uint8_t *block) {
+  if (cache->next)
+    accessLevel(h, cache->next, address, block, cache->geometry.blockSize, MODE_READ);
+  else
+    accessDRAM(h, address, block, cache->geometry.blockSize, MODE_READ);
+}
+
+/*------------------------------------------------------------------------------
+Drains the buffer entry at position into the next level. The drain runs in
+the background, from when the previous drain ended (or the entry was queued)
+for as long as the next level takes; with wait, the program then stalls
+until it is done.
 ------------------------------------------------------------------------------*/
-void initCacheL1() {
-  L1Cache.init = 1;
-  for (int i = 0; i < L1_CACHE_LINES; i++ ){
-    L1Cache.lines[i].Valid = 0;
-    L1Cache.lines[i].Dirty = 0;
-    L1Cache.lines[i].Tag = 0;
+static void retireWrite(Hierarchy *h, Cache *cache, uint32_t position, int wait) {
+
+  WriteBuffer *buffer = cache->buffer;
+  uint32_t slot = buffer->order[position];
+  uint32_t blockSize = buffer->blockSize;
+  const uint8_t *valid = &buffer->valid[(size_t)slot * blockSize];
+  uint8_t *data = buffer->data ? &buffer->data[(size_t)slot * blockSize] : NULL;
+  uint64_t now = h->time;
+
+  h->time = buffer->drainTime > buffer->queued[slot] ? buffer->drainTime : buffer->queued[slot];
+  if (h->timing)
+    h->timing->background++;
+
+  // one write per run of written bytes, the whole block when complete
+  for (uint32_t first = 0; first < blockSize;) {
+    if (!valid[first]) {
+      first++;
+      continue;
+    }
+    uint32_t last = first;
+    while (last < blockSize && valid[last])
+      last++;
+    writeNext(h, cache, buffer->blocks[slot] + first, data ? &data[first] : NULL, last - first);
+    first = last;
+  }
+
+  if (h->timing)
+    h->timing->background--;
+  buffer->drainTime = h->time;
+  h->time = now;
+  removeWriteBuffer(buffer, position);
 
-    // set all words to 0
-    for (int j = 0; j < BLOCK_SIZE; j += WORD_SIZE)
-      L1Cache.lines[i].Data[j] = 0;
-    
+  if (wait && buffer->drainTime > h->time) {
+    cache->stats.bufferStall += buffer->drainTime - h->time;
+    h->time = buffer->drainTime;
   }
 }
 
 /*------------------------------------------------------------------------------
-Program's access point to the L1 Cache.
+Sends size bytes at address down from cache: through its write buffer if it
+has one (waiting for the oldest entry when full), else synchronously.
 ------------------------------------------------------------------------------*/
-void accessL1(uint32_t address, uint8_t *data, uint32_t mode) {
+static void writeBelow(Hierarchy *h, Cache *cache, uint64_t address, uint8_t *data, uint32_t size) {
 
-  uint32_t index, Tag, MemAddress, offset;
-  uint8_t TempBlock[BLOCK_SIZE];
-  memset(TempBlock, 0, BLOCK_SIZE);
+  WriteBuffer *buffer = cache->buffer;
 
-  // init cache
-  if (L1Cache.init == 0) {
-    initCacheL1();
+  if (!buffer) {
+    writeNext(h, cache, address, data, size);
+    return;
   }
 
-  Tag = getTag(address);
-  index = getIndex(address);
-  offset = getOffset(address);
-  
-  // gets line of the right index
-  CacheLine *Line = &L1Cache.lines[index];
+  if (buffer->count == buffer->capacity &&
+      findWriteBuffer(buffer, getMemAddress(&cache->geometry, address)) < 0)
+    retireWrite(h, cache, 0, 1);
+  cache->stats.coalesced += (uint64_t)putWriteBuffer(buffer, address, data, size, h->time);
+}
 
-  /* access cache */
+/*------------------------------------------------------------------------------
+Before the block at address is read from the next level: a queued write to
+it must get there first.
+------------------------------------------------------------------------------*/
+static inline void drainBlock(Hierarchy *h, Cache *cache, uint64_t address) {
 
-  // if block NOT present - miss
-  if (!Line->Valid || Line->Tag != Tag) {  
-    
-      MemAddress = getMemAddress(address); // get address of the block in memory
-      accessL2(MemAddress, TempBlock, MODE_READ); // reads new block from L2
+  int position;
+
+  if (cache->buffer && (position = findWriteBuffer(cache->buffer, address)) >= 0)
+    retireWrite(h, cache, (uint32_t)position, 1);
+}
+
+/*------------------------------------------------------------------------------
+Drains every write buffer, L1s first and down level by level, then the
+writes DRAM still has queued, and waits for the last drain.
+------------------------------------------------------------------------------*/
+void flushWriteBuffers(Hierarchy *h) {
+
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    while (h->l1[core].buffer && h->l1[core].buffer->count)
+      retireWrite(h, &h->l1[core], 0, 1);
+  }
+  for (uint32_t i = 0; i < h->config.levels - 1; i++) {
+    while (h->lower[i].buffer && h->lower[i].buffer->count)
+      retireWrite(h, &h->lower[i], 0, 1);
+  }
+  if (h->controller)
+    h->time = drainDram(h->controller, &h->dramStats, h->time);
+}
+
+
+
+/*******************************************************************************
+ Prefetching
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+A line leaves cache: if it was prefetched and never used, so was the
+prefetch.
+------------------------------------------------------------------------------*/
+static inline void dropPrefetch(Cache *cache, size_t line) {
+  if (cache->prefetched && cache->prefetched[line]) {
+    cache->stats.prefetchUseless++;
+    cache->prefetched[line] = 0;
+  }
+}
 
-    if ((Line->Valid) && (Line->Dirty)) { // line has dirty block
-      accessL2(MemAddress, Line->Data, MODE_WRITE); // write back old block to L2
+/*------------------------------------------------------------------------------
+First demand hit on a prefetched line: waits for its fill if it has not
+ended yet, or, if it has not even begun, issues it itself and waits only as
+long as the fill takes. With timing = event a demand access does not wait
+here but completes when the fill arrives, as if merged into its MSHR.
+Returns 1, as the hit trains the prefetcher like a miss.
+------------------------------------------------------------------------------*/
+static int usePrefetch(Hierarchy *h, Cache *cache, size_t line) {
+
+  uint64_t ready = cache->ready[line];
+
+  cache->prefetched[line] = 0;
+  cache->stats.prefetchUseful++;
+  if (cache->start[line] > h->time)
+    ready = h->time + (ready - cache->start[line]);
+  if (ready > h->time) {
+    cache->stats.prefetchLate++;
+    if (h->timing && !h->timing->background) {
+      uint64_t *arrival = cache->level > 1 ? &h->timing->l2Ready : &h->timing->l1Ready;
+      *arrival = ready > *arrival ? ready : *arrival;
     }
+    else
+      h->time = ready;
+  }
+  return 1;
+}
+
+/* Demand miss on block (a block number): was it evicted by a prefetch? */
+static inline void checkPollution(Cache *cache, uint64_t block) {
 
-    memcpy(Line->Data, TempBlock, BLOCK_SIZE); // copy new block to cache line
+  uint64_t *evicted = &cache->prefetcher->evicted[pollutionSlot(block)];
 
-    Line->Valid = 1;
-    Line->Tag = Tag;
-    Line->Dirty = 0;
+  if (*evicted == block + 1) {
+    cache->stats.prefetchPolluting++;
+    *evicted = 0;
   }
+}
 
-  if (mode == MODE_READ){ // read data from cache line
-    memcpy(data, &(Line->Data[offset]), WORD_SIZE);
-    time += L1_READ_TIME;
+/*------------------------------------------------------------------------------
+Fetches the block at address into cache ahead of demand. The fill runs in
+the background, from when the previous one ended (with timing = event, right
+away), for as long as the next level (and, for an L1, the snoop) takes. Blocks already present or beyond
+dram_size are skipped, and so is everything while PREFETCH_QUEUE fills are
+still pending.
+------------------------------------------------------------------------------*/
+static void prefetchBlock(Hierarchy *h, Cache *cache, uint64_t address) {
+
+  Prefetcher *prefetcher = cache->prefetcher;
+  const Geometry *geometry = &cache->geometry;
+  uint32_t index = getIndex(geometry, address);
+  size_t set = (size_t)index * geometry->ways;
+  uint64_t *tags = &cache->tags[set];
+  uint64_t tag = getTag(geometry, address);
+  uint8_t block[MAX_BLOCK_SIZE];
+  uint64_t now = h->time;
+  int sharers = 0;
+
+  if (findWay(cache, tags, tag) >= 0 || (cache->victim && holdsBlock(cache->victim, address)) ||
+      (h->config.dramSize && address > h->config.dramSize - geometry->blockSize) ||
+      prefetcher->pending[prefetcher->next] > now)
+    return;
+
+  // one fill after the other, unless misses overlap (timing = event)
+  if (!h->timing && prefetcher->engineFree > now)
+    h->time = prefetcher->engineFree;
+  uint64_t start = h->time;
+  if (h->timing)
+    h->timing->background++;
+
+  if (cache->shared) { // BusRd on behalf of the core
+    int lost = findWay(cache, &cache->stale[set], tag);
+    if (lost >= 0)
+      cache->stale[set + lost] = INVALID_TAG;
+    sharers = snoopL1(h, (uint32_t)(cache - h->l1), address, 0);
   }
 
-  if (mode == MODE_WRITE){ // write data from cache line
-    memcpy(&(Line->Data[offset]), data, WORD_SIZE);
-    time += L1_WRITE_TIME;
-    Line->Dirty = 1;
+  uint32_t way = chooseVictim(cache, tags, index);
+  size_t line = set + way;
+
+  uint8_t dirty = 0;
+
+  drainBlock(h, cache, address);
+  if (cache->level == 1)
+    dirty = fillL1(h, address, block, sharers);
+  else
+    readNext(h, cache, address, block);
+
+  if (tags[way] != INVALID_TAG) {
+    uint64_t evicted = getBlockAddress(geometry, tags[way], index);
+    uint64_t number = evicted >> geometry->offsetBits;
+
+    cache->stats.evictions++;
+    dropPrefetch(cache, line);
+    prefetcher->evicted[pollutionSlot(number)] = number + 1;
+    if (cache->victim)
+      evictToVictim(h, cache, line, index);
+    else if (cache->level == 1)
+      evictL1(h, cache, evicted, lineData(cache, line), cache->dirty[line]);
+    else {
+      if (h->config.inclusion == INCLUSION_INCLUSIVE)
+        backInvalidate(h, cache, line, evicted);
+      if (cache->dirty[line]) {
+        cache->stats.dirtyEvictions++;
+        writeBelow(h, cache, evicted, lineData(cache, line), geometry->blockSize);
+      }
+    }
   }
+
+  if (cache->data)
+    memcpy(lineData(cache, line), block, geometry->blockSize);
+  tags[way] = tag;
+  cache->dirty[line] = dirty;
+  if (cache->shared)
+    cache->shared[line] = (uint8_t)sharers;
+  cache->prefetched[line] = 1;
+  cache->stats.fills++;
+  cache->stats.prefetchIssued++;
+  insertLine(&cache->repl, index, way);
+
+  if (h->timing)
+    h->timing->background--;
+  prefetcher->engineFree = h->time;
+  prefetcher->pending[prefetcher->next] = h->time;
+  prefetcher->next = (prefetcher->next + 1) % PREFETCH_QUEUE;
+  cache->start[line] = start;
+  cache->ready[line] = h->time;
+  h->time = now;
+}
+
+/*------------------------------------------------------------------------------
+Trains the prefetcher of cache with a demand access to address (trigger: a
+miss or the first hit on a prefetched line) and issues what it proposes.
+------------------------------------------------------------------------------*/
+static void prefetchAfter(Hierarchy *h, Cache *cache, uint64_t address, int trigger) {
+
+  uint64_t blocks[MAX_PREFETCH_DEGREE];
+  uint32_t offsetBits = cache->geometry.offsetBits;
+  uint32_t count = trainPrefetcher(cache->prefetcher, address >> offsetBits, trigger, blocks);
+
+  for (uint32_t i = 0; i < count; i++)
+    prefetchBlock(h, cache, blocks[i] << offsetBits);
 }
 
 
 
 /*******************************************************************************
- L2 cache 
+ Inclusion
 *******************************************************************************/
 
-/*------------------------------------------------------------------------------ 
-Initializes L2 Cache.
+/*------------------------------------------------------------------------------
+Exclusive L2: an L1 fill of the block at address. On a hit the block leaves
+L2 (unless keep: other L1s still share it) and its dirty bit there is
+returned, for the L1 line to take over; on a miss it comes from the level
+below (which keeps what it fetches) without being allocated in L2.
 ------------------------------------------------------------------------------*/
-void initCacheL2() {
-  L2Cache.init = 1;
-  for (int i = 0; i < L2_CACHE_SETS; i++){
-    for(int j = 0; j < WAYS; j++){
-      L2Cache.sets->lines[i].Valid = 0;
-      L2Cache.sets->lines[i].Dirty = 0;
-      L2Cache.sets->lines[i].Tag = 0;
-      L2Cache.sets->lines[i].Time = 0;
+static uint8_t readExclusive(Hierarchy *h, uint64_t address, uint8_t *block, int keep) {
+
+  Cache *L2Cache = h->lower;
+  const Geometry *geometry = &L2Cache->geometry;
+  uint32_t index = getIndex(geometry, address);
+  size_t set = (size_t)index * geometry->ways;
+  int way = findWay(L2Cache, &L2Cache->tags[set], getTag(geometry, address));
+  int trigger = way < 0;
+  uint8_t dirty = 0;
+
+  if (h->listener)
+    h->listener(h->listenerContext, address, MODE_READ);
+  countAccess(L2Cache, address, MODE_READ, way >= 0);
+
+  if (way < 0) {
+    if (L2Cache->prefetcher)
+      checkPollution(L2Cache, address >> geometry->offsetBits);
+    drainBlock(h, L2Cache, address);
+    readNext(h, L2Cache, address, block);
+  }
+  else {
+    size_t line = set + (size_t)way;
+
+    if (L2Cache->prefetched && L2Cache->prefetched[line])
+      trigger = usePrefetch(h, L2Cache, line);
+    if (L2Cache->data)
+      memcpy(block, lineData(L2Cache, line), geometry->blockSize);
+    if (keep)
+      touchLine(&L2Cache->repl, index, (uint32_t)way);
+    else {
+      dirty = L2Cache->dirty[line];
+      L2Cache->tags[line] = INVALID_TAG;
+      L2Cache->dirty[line] = 0;
+    }
+  }
+  h->time += L2Cache->readTime;
 
-      /* sets words to 0 */
-      for (int f = 0; f < BLOCK_SIZE; f += WORD_SIZE){
-        L2Cache.sets[i].lines[j].Data[f] = 0;
+  if (L2Cache->prefetcher)
+    prefetchAfter(h, L2Cache, address, trigger);
+  return dirty;
+}
 
+/*------------------------------------------------------------------------------
+Exclusive L2: the L1 victim at address moves in, dirty or not (a block that
+other L1s shared may already be there: the two merge). The line it replaces
+leaves the hierarchy, written back if dirty.
+------------------------------------------------------------------------------*/
+static void insertL2(Hierarchy *h, uint64_t address, uint8_t *data, uint8_t dirty) {
+
+  Cache *L2Cache = h->lower;
+  const Geometry *geometry = &L2Cache->geometry;
+  uint32_t index = getIndex(geometry, address);
+  size_t set = (size_t)index * geometry->ways;
+  uint64_t *tags = &L2Cache->tags[set];
+  int way = findWay(L2Cache, tags, getTag(geometry, address));
+
+  if (h->listener)
+    h->listener(h->listenerContext, address, MODE_WRITE);
+
+  if (way >= 0)
+    touchLine(&L2Cache->repl, index, (uint32_t)way);
+  else {
+    way = (int)chooseVictim(L2Cache, tags, index);
+    if (tags[way] != INVALID_TAG) {
+      L2Cache->stats.evictions++;
+      dropPrefetch(L2Cache, set + way);
+      if (L2Cache->dirty[set + way]) {
+        L2Cache->stats.dirtyEvictions++;
+        writeBelow(h, L2Cache, getBlockAddress(geometry, tags[way], index),
+                   lineData(L2Cache, set + way), geometry->blockSize);
       }
     }
+    tags[way] = getTag(geometry, address);
+    L2Cache->dirty[set + way] = 0;
+    L2Cache->stats.fills++;
+    insertLine(&L2Cache->repl, index, (uint32_t)way);
   }
+
+  if (L2Cache->data)
+    memcpy(lineData(L2Cache, set + way), data, geometry->blockSize);
+  if (dirty && L2Cache->writeThrough) {
+    L2Cache->stats.writesDown++;
+    writeBelow(h, L2Cache, address, data, geometry->blockSize);
+  }
+  else
+    L2Cache->dirty[set + way] |= dirty;
+  h->time += L2Cache->writeTime;
 }
 
+/*------------------------------------------------------------------------------
+An L1 fill of the block at address from L2, other L1s keeping a copy if
+sharers. Returns the dirty bit the L1 line starts with (exclusive L2 only).
+------------------------------------------------------------------------------*/
+static uint8_t fillL1(Hierarchy *h, uint64_t address, uint8_t *block, int sharers) {
+
+  if (h->config.inclusion == INCLUSION_EXCLUSIVE)
+    return readExclusive(h, address, block, sharers);
+  accessLevel(h, h->lower, address, block, h->lower->geometry.blockSize, MODE_READ);
+  return 0;
+}
 
 /*------------------------------------------------------------------------------
-Program's access point to the L2 Cache.
+A valid line at address leaves an L1 (or its victim cache) for good: with
+an exclusive L2 it moves there, else it is written back if dirty.
+------------------------------------------------------------------------------*/
+static void evictL1(Hierarchy *h, Cache *cache, uint64_t address, uint8_t *data, uint8_t dirty) {
 
-2 way set associative cache with LRU
+  cache->stats.dirtyEvictions += dirty;
+  if (h->config.inclusion == INCLUSION_EXCLUSIVE)
+    insertL2(h, address, data, dirty);
+  else if (dirty)
+    writeBelow(h, cache, address, data, cache->geometry.blockSize);
+}
+
+/* Drops the copy cache (a level above target, or a victim cache, counting
+   in stats) has of the block at address, merging it into target line when
+   dirty. */
+static void dropCopy(Cache *cache, LevelStats *stats, Cache *target, size_t line,
+                     uint64_t address) {
+
+  const Geometry *geometry = &cache->geometry;
+  size_t set = (size_t)getIndex(geometry, address) * geometry->ways;
+  int way = findWay(cache, &cache->tags[set], getTag(geometry, address));
+
+  if (way < 0)
+    return;
+
+  size_t copy = set + (size_t)way;
+  stats->backInvalidations++;
+  if (cache->dirty[copy]) {
+    if (target->data)
+      memcpy(lineData(target, line), lineData(cache, copy), geometry->blockSize);
+    target->dirty[line] = 1;
+  }
+  dropPrefetch(cache, copy);
+  cache->tags[copy] = INVALID_TAG;
+  cache->dirty[copy] = 0;
+  if (cache->shared)
+    cache->shared[copy] = 0;
+}
+
+/*------------------------------------------------------------------------------
+Inclusive hierarchy: the block at address is evicted from line of cache (a
+shared level), so its copies leave every level above too, L1 victim caches
+included. Dirty copies are newer than cache's, the closest to the cores the
+newest: they are merged in that order and written back with it.
 ------------------------------------------------------------------------------*/
-void accessL2(uint32_t address, uint8_t *data, uint32_t mode) {
+static void backInvalidate(Hierarchy *h, Cache *cache, size_t line, uint64_t address) {
 
-  uint32_t index, Tag, MemAddress, offset;
-  uint8_t TempBlock[BLOCK_SIZE];
-  memset(TempBlock, 0, BLOCK_SIZE);
+  for (Cache *upper = cache; upper-- > h->lower;)
+    dropCopy(upper, &upper->stats, cache, line, address);
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    Cache *l1 = &h->l1[core];
 
-  /* init cache */
-  if (L2Cache.init == 0) {
-    initCacheL2();
+    dropCopy(l1, &l1->stats, cache, line, address);
+    if (l1->victim)
+      dropCopy(l1->victim, &l1->stats, cache, line, address);
   }
+}
 
-  Tag = getTag(address);
-  index = getIndex(address);
-  offset = getOffset(address);
 
-  // gets Set of the right index
-  Set *Set= &L2Cache.sets[index];
-
-  /* access Cache*/
-  for(int i = 0; i < WAYS; i++){
-
-    /*its a hit*/
-    if(Set->lines[i].Valid && Set->lines[i].Tag == Tag){
-      if (mode == MODE_READ){ // read data from cache line
-        memcpy(data, &(Set->lines[i].Data[offset]), WORD_SIZE);
-        time += L2_READ_TIME;
-        Set->lines[i].Time = time;
-        return;
-      }
 
-      if (mode == MODE_WRITE){ // write data from cache line
-        memcpy(&(Set->lines[i].Data[offset]), data, WORD_SIZE);
-        time += L2_WRITE_TIME;
-        Set->lines[i].Dirty = 1;
-        Set->lines[i].Time = time;
-        return;
-      }
-    }
+/*******************************************************************************
+ Event timing
+*******************************************************************************/
+
+/* Read latency of an L1 fill that found its block after missed shared
+   levels (DRAM after all of them), from L2 down. */
+static uint64_t fillLatency(const Hierarchy *h, uint32_t missed) {
+
+  uint32_t shared = h->config.levels - 1;
+  uint64_t latency = missed == shared ? h->config.dramReadTime : 0;
+
+  for (uint32_t i = 0; i <= missed && i < shared; i++)
+    latency += h->lower[i].readTime;
+  return latency;
+}
+
+/*------------------------------------------------------------------------------
+When the block at address, requested from shared level i (0: L2) at time
+request by a miss above, leaves it. A block the level is still filling
+merges into its MSHR; a miss there takes one (waiting for it if they are all
+busy) until the level below (DRAM, below the last) answers, and so on down:
+every shared level bounds and merges its own outstanding misses.
+------------------------------------------------------------------------------*/
+static uint64_t scheduleLevel(Hierarchy *h, uint32_t i, uint64_t block, uint64_t request) {
+
+  Timing *timing = h->timing;
+
+  if (i == timing->shared)
+    return h->controller ? readDram(h->controller, &h->dramStats, block, request)
+                         : request + h->config.dramReadTime;
+
+  Cache *cache = &h->lower[i];
+  MshrFile *mshrs = &timing->lower[i];
+  int entry = findMshr(mshrs, block, request);
+
+  if (entry >= 0) {
+    cache->stats.mshrMerged++;
+    return mshrs->ready[entry] + cache->readTime;
+  }
+  if (i >= timing->missed) {
+    if (i == 0) // a late prefetch counts from its arrival
+      request = timing->l2Ready > request ? timing->l2Ready : request;
+    return request + cache->readTime;
   }
 
-  /*its a miss*/
-  /*determine which line from set to replace*/
-  uint32_t leastrecent = 0;
-  int way = 0;
-  for(int i = WAYS; i > 0; i--){
-    if(Set->lines[i].Time < leastrecent || !leastrecent || !Set->lines[i].Valid ){
-      leastrecent = Set->lines[i].Time;
-      way = i;
+  uint64_t start = request;
+  uint32_t slot = allocateMshr(mshrs, &start);
+  uint64_t arrival = scheduleLevel(h, i + 1, block, start);
+
+  cache->stats.mshrStall += start - request;
+  completeMshr(mshrs, slot, block, arrival);
+  return arrival + cache->readTime;
+}
+
+/* When the block requested from L2 at time request by an L1 miss gets to L1. */
+static uint64_t scheduleFill(Hierarchy *h, uint64_t block, uint64_t request) {
+  return scheduleLevel(h, 0, block, request);
+}
+
+/*------------------------------------------------------------------------------
+Times the access core just issued at time issue, which the serial model
+charged h->time - issue. A hit completes after that; so does a hit on a
+block whose fill (or late prefetch) is outstanding, counted from its arrival. A miss takes an L1
+MSHR (the core waits if they are all busy), pays whatever the serial model
+charged beyond the latencies of its levels (write-backs, snoops, ...) and
+completes when its fill arrives; the core goes on after the L1 access time
+without waiting for it. Leaves the latest completion in h->time.
+------------------------------------------------------------------------------*/
+static void scheduleAccess(Hierarchy *h, uint32_t core, uint64_t address, uint32_t mode,
+                           uint64_t issue) {
+
+  Timing *timing = h->timing;
+  Cache *L1Cache = &h->l1[core];
+  MshrFile *mshrs = &timing->l1[core];
+  uint64_t block = getMemAddress(&L1Cache->geometry, address);
+  uint64_t serial = h->time - issue;
+  uint64_t done;
+  int entry = findMshr(mshrs, block, issue);
+
+  if (!timing->l1Miss) {
+    uint64_t from = timing->l1Ready > issue ? timing->l1Ready : issue;
+    if (entry >= 0) {
+      L1Cache->stats.mshrMerged++;
+      from = mshrs->ready[entry] > from ? mshrs->ready[entry] : from;
     }
+    done = from + serial;
+    timing->clock[core] = issue + serial;
+  }
+  else {
+    uint32_t l1Time = mode == MODE_READ ? L1Cache->readTime : L1Cache->writeTime;
+    uint64_t latency = l1Time + fillLatency(h, timing->missed);
+    uint64_t start = issue;
+    uint32_t slot = allocateMshr(mshrs, &start);
+    uint64_t fill = scheduleFill(h, block, start + (serial > latency ? serial - latency : 0));
+
+    L1Cache->stats.mshrStall += start - issue;
+    completeMshr(mshrs, slot, block, fill);
+    done = fill + l1Time;
+    timing->clock[core] = start + l1Time;
+  }
+
+  if (done > timing->finish)
+    timing->finish = done;
+  h->time = timing->finish;
+}
+
+
+
+/*******************************************************************************
+ L1 cache
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Initializes the L1 Cache of every core.
+------------------------------------------------------------------------------*/
+void initCacheL1(Hierarchy *h) {
+  for (uint32_t core = 0; core < h->config.cores; core++)
+    initLevel(&h->l1[core]);
+}
+
+/*------------------------------------------------------------------------------
+Snoop of one cache (an L1 or its victim cache) for the block at address: a
+copy in M is written back to L2, then it is invalidated if exclusive (the
+tag is kept in stale, to count the coherence miss that may follow) or drops
+to S. Counts go to stats. Returns 1 if the cache still holds the block.
+------------------------------------------------------------------------------*/
+static int snoopCache(Hierarchy *h, Cache *cache, LevelStats *stats, uint64_t address,
+                      int exclusive) {
+
+  const Geometry *geometry = &cache->geometry;
+  uint32_t index = getIndex(geometry, address);
+  size_t set = (size_t)index * geometry->ways;
+  int way = findWay(cache, &cache->tags[set], getTag(geometry, address));
+
+  if (way < 0)
+    return 0;
+
+  size_t line = set + (size_t)way;
+  if (cache->dirty[line]) { // M: the owner supplies the block through L2
+    stats->coherenceWritebacks++;
+    if (h->config.inclusion == INCLUSION_EXCLUSIVE) // L2 may not have it: no fetch
+      insertL2(h, getMemAddress(geometry, address), lineData(cache, line), 1);
+    else
+      accessLevel(h, h->lower, getMemAddress(geometry, address), lineData(cache, line),
+                  geometry->blockSize, MODE_WRITE);
+    cache->dirty[line] = 0;
+  }
+
+  if (!exclusive) {
+    cache->shared[line] = 1;
+    return 1;
+  }
+  stats->invalidations++;
+  cache->stale[line] = cache->tags[line];
+  cache->tags[line] = INVALID_TAG;
+  cache->shared[line] = 0;
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Snoops the L1s of the other cores for the block at address (MESI over a
+shared bus), draining first the writes they still have queued for it.
+Returns 1 if some other L1 still holds the block.
+------------------------------------------------------------------------------*/
+static int snoopL1(Hierarchy *h, uint32_t requester, uint64_t address, int exclusive) {
+
+  int sharers = 0;
+
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    Cache *other = &h->l1[core];
+
+    if (core == requester)
+      continue;
+    drainBlock(h, other, address);
+    sharers |= snoopCache(h, other, &other->stats, address, exclusive);
+    if (other->victim)
+      sharers |= snoopCache(h, other->victim, &other->stats, address, exclusive);
   }
-  MemAddress = getMemAddress(address) ;  // get address of the block in memory
-  accessDRAM(MemAddress, TempBlock, MODE_READ); // access memory and get block
+  return sharers;
+}
 
-  if ((Set->lines[way].Valid) && (Set->lines[way].Dirty)) { // valid line w dirty block
-    accessDRAM(MemAddress, Set->lines[way].Data, MODE_WRITE); // then write back old block
+/*------------------------------------------------------------------------------
+On an L1 miss, looks for the block in the victim cache. If it is there it
+swaps places with the line the L1 evicts for it (in victim_time) and the way
+it now occupies is returned; otherwise -1.
+------------------------------------------------------------------------------*/
+static int swapVictim(Hierarchy *h, Cache *cache, uint64_t address, uint32_t kind) {
+
+  Cache *victim = cache->victim;
+  const Geometry *geometry = &cache->geometry;
+  uint32_t index = getIndex(geometry, address);
+  size_t set = (size_t)index * geometry->ways;
+  int entry = findWay(victim, victim->tags, getTag(&victim->geometry, address));
+
+  if (entry < 0)
+    return -1;
+
+  uint32_t way = chooseVictim(cache, &cache->tags[set], index);
+  size_t line = set + way;
+  uint64_t evicted = cache->tags[line];
+  uint8_t dirty = cache->dirty[line];
+
+  cache->stats.victimHits++;
+  cache->stats.victimConflicts += kind == MISS_CONFLICT;
+  cache->stats.evictions += evicted != INVALID_TAG;
+  dropPrefetch(cache, line);
+
+  cache->tags[line] = getTag(geometry, address);
+  cache->dirty[line] = victim->dirty[entry];
+  victim->tags[entry] = evicted == INVALID_TAG ? INVALID_TAG :
+                        getTag(&victim->geometry, getBlockAddress(geometry, evicted, index));
+  victim->dirty[entry] = dirty;
+  if (cache->shared) {
+    uint8_t shared = cache->shared[line];
+    cache->shared[line] = victim->shared[entry];
+    victim->shared[entry] = shared;
+    cache->stale[line] = INVALID_TAG;
+  }
+  if (cache->data) {
+    uint8_t block[MAX_BLOCK_SIZE];
+    memcpy(block, lineData(cache, line), geometry->blockSize);
+    memcpy(lineData(cache, line), lineData(victim, (size_t)entry), geometry->blockSize);
+    memcpy(lineData(victim, (size_t)entry), block, geometry->blockSize);
   }
 
-  memcpy(Set->lines[way].Data, TempBlock, BLOCK_SIZE); // copy new block to cache line
+  insertLine(&cache->repl, index, way);
+  if (evicted != INVALID_TAG)
+    insertLine(&victim->repl, 0, (uint32_t)entry);
+  h->time += victim->readTime;
+  return (int)way;
+}
+
+/*------------------------------------------------------------------------------
+Moves the valid L1 line evicted from set index into the victim cache, whose
+own LRU line leaves the L1 (evictL1).
+------------------------------------------------------------------------------*/
+static void evictToVictim(Hierarchy *h, Cache *cache, size_t line, uint32_t index) {
+
+  Cache *victim = cache->victim;
+  uint32_t blockSize = cache->geometry.blockSize;
+  uint64_t block = getBlockAddress(&cache->geometry, cache->tags[line], index);
+  uint32_t entry = chooseVictim(victim, victim->tags, 0);
+
+  if (victim->tags[entry] != INVALID_TAG)
+    evictL1(h, cache, getBlockAddress(&victim->geometry, victim->tags[entry], 0),
+            lineData(victim, entry), victim->dirty[entry]);
+
+  victim->tags[entry] = getTag(&victim->geometry, block);
+  victim->dirty[entry] = cache->dirty[line];
+  if (victim->shared)
+    victim->shared[entry] = cache->shared[line];
+  if (victim->data)
+    memcpy(lineData(victim, entry), lineData(cache, line), blockSize);
+  insertLine(&victim->repl, 0, entry);
+}
+
+/*------------------------------------------------------------------------------
+An access by core of size bytes within one block, through its L1 and below
+(the serial model).
+------------------------------------------------------------------------------*/
+static void demandL1(Hierarchy *h, uint32_t core, uint64_t address, uint8_t *data, uint32_t size,
+                     uint32_t mode) {
+
+  uint32_t index, offset;
+  uint64_t Tag, MemAddress;
+  uint8_t TempBlock[MAX_BLOCK_SIZE];
+  Cache *L1Cache = &h->l1[core];
+
+  const Geometry *geometry = &L1Cache->geometry;
+  Tag = getTag(geometry, address);
+  index = getIndex(geometry, address);
+  offset = getOffset(geometry, address);
+
+  // gets set of the right index
+  size_t set = (size_t)index * geometry->ways;
+  uint64_t *Tags = &L1Cache->tags[set];
+  int way = findWay(L1Cache, Tags, Tag);
+
+  uint32_t kind = countAccess(L1Cache, address, mode, way >= 0);
+  int trigger = way < 0;
+
+  if (way < 0 && L1Cache->prefetcher)
+    checkPollution(L1Cache, address >> geometry->offsetBits);
+  if (way < 0 && L1Cache->victim)
+    way = swapVictim(h, L1Cache, address, kind);
+
+  /* access cache */
+
+  // if block NOT present - miss
+  if (way < 0) {
+    int sharers = 0;
 
-  Set->lines[way].Valid = 1;
-  Set->lines[way].Tag = Tag;
-  Set->lines[way].Dirty = 0;
+    MemAddress = getMemAddress(geometry, address); // get address of the block in memory
+
+    if (L1Cache->shared) { // other cores: BusRd (read) or BusRdX (write)
+      int lost = findWay(L1Cache, &L1Cache->stale[set], Tag);
+      if (lost >= 0) {
+        L1Cache->stats.coherenceMisses++;
+        L1Cache->stale[set + lost] = INVALID_TAG;
+      }
+      sharers = snoopL1(h, core, MemAddress, mode == MODE_WRITE);
+    }
+
+    if (mode == MODE_WRITE && !L1Cache->writeAllocate) { // write around L1
+      L1Cache->stats.writesDown++;
+      writeBelow(h, L1Cache, address, data, size);
+      h->time += L1Cache->writeTime;
+      return;
+    }
+
+    way = (int)chooseVictim(L1Cache, Tags, index);
+
+    drainBlock(h, L1Cache, MemAddress);
+    if (h->timing) {
+      h->timing->l1Miss = 1;
+      h->timing->missed = missedLevels(h, MemAddress);
+      h->timing->fill = 1;
+    }
+    uint8_t dirty = fillL1(h, MemAddress, TempBlock, sharers); // reads new block from L2
+    if (h->timing)
+      h->timing->fill = 0;
+
+    L1Cache->stats.evictions += Tags[way] != INVALID_TAG;
+    dropPrefetch(L1Cache, set + way);
+    if (Tags[way] != INVALID_TAG && L1Cache->victim)
+      evictToVictim(h, L1Cache, set + way, index);
+    else if (Tags[way] != INVALID_TAG) // write back old block to L2 if dirty
+      evictL1(h, L1Cache, getBlockAddress(geometry, Tags[way], index),
+              lineData(L1Cache, set + way), L1Cache->dirty[set + way]);
+
+    if (L1Cache->data)
+      memcpy(lineData(L1Cache, set + way), TempBlock, geometry->blockSize); // copy new block to cache line
+
+    Tags[way] = Tag;
+    L1Cache->dirty[set + way] = dirty;
+    if (L1Cache->shared) {
+      L1Cache->shared[set + way] = (uint8_t)sharers; // S, or E when alone
+      L1Cache->stale[set + way] = INVALID_TAG;
+    }
+    L1Cache->stats.fills++;
+    insertLine(&L1Cache->repl, index, (uint32_t)way);
+  }
+  else {
+    touchLine(&L1Cache->repl, index, (uint32_t)way);
+    if (L1Cache->prefetched && L1Cache->prefetched[set + way])
+      trigger = usePrefetch(h, L1Cache, set + way);
+
+    if (mode == MODE_WRITE && L1Cache->shared && L1Cache->shared[set + way]) {
+      // S -> M: invalidate the other copies, one bus transaction at L2 latency
+      L1Cache->stats.upgrades++;
+      snoopL1(h, core, getMemAddress(geometry, address), 1);
+      L1Cache->shared[set + way] = 0;
+      h->time += h->lower->readTime;
+    }
+  }
+
+  uint8_t *Data = lineData(L1Cache, set + way);
 
   if (mode == MODE_READ){ // read data from cache line
-    memcpy(data, &(Set->lines[way].Data[offset]), WORD_SIZE);
-    time += L2_READ_TIME;
+    if (Data)
+      memcpy(data, &(Data[offset]), size);
+    else
+      memset(data, 0, size);
+    h->time += L1Cache->readTime;
   }
 
-  // copy info from data to cache line 
   if (mode == MODE_WRITE){ // write data from cache line
-    memcpy(&(Set->lines[way].Data[offset]), data, WORD_SIZE);
-    time += L2_WRITE_TIME;
-    // it's unsynced w main memory
-    Set->lines[way].Dirty = 1;
+    if (Data)
+      memcpy(&(Data[offset]), data, size);
+    h->time += L1Cache->writeTime;
+    if (L1Cache->writeThrough) { // the line stays clean
+      L1Cache->stats.writesDown++;
+      writeBelow(h, L1Cache, address, data, size);
+    }
+    else
+      L1Cache->dirty[set + way] = 1; // E or S -> M
+  }
+
+  if (L1Cache->prefetcher)
+    prefetchAfter(h, L1Cache, address, trigger);
+}
+
+/* demandL1, timed by the model in use. */
+static inline void timedL1(Hierarchy *h, uint32_t core, uint64_t address, uint8_t *data,
+                           uint32_t size, uint32_t mode) {
+
+  if (!h->timing) {
+    demandL1(h, core, address, data, size, mode);
+    return;
+  }
+
+  uint64_t issue = h->timing->clock[core];
+
+  h->time = issue;
+  h->timing->l1Miss = 0;
+  h->timing->missed = 0;
+  h->timing->l1Ready = 0;
+  h->timing->l2Ready = 0;
+  demandL1(h, core, address, data, size, mode);
+  scheduleAccess(h, core, address, mode, issue);
+}
+
+/* An access of any size and alignment, one timedL1 per block it touches. */
+static inline void splitL1(Hierarchy *h, uint32_t core, uint64_t address, uint8_t *data,
+                           uint32_t size, uint32_t mode) {
+
+  const Geometry *geometry = &h->l1[core].geometry;
+
+  if (getOffset(geometry, address) + size <= geometry->blockSize) {
+    timedL1(h, core, address, data, size, mode);
+    return;
+  }
+  h->l1[core].stats.splits++;
+  for (uint32_t done = 0; done < size;) {
+    uint32_t part = geometry->blockSize - getOffset(geometry, address + done);
+    if (part > size - done)
+      part = size - done;
+    timedL1(h, core, address + done, data + done, part, mode);
+    done += part;
   }
-  Set->lines[way].Time = time;
+}
+
+/* Records an access in the event log, if its level takes it. */
+static void logAccess(Hierarchy *h, uint32_t core, uint64_t address, const uint8_t *data,
+                      uint32_t size, uint32_t mode, int miss) {
+
+  EventRecord record = {h->time, address, 0, (uint8_t)mode, (uint8_t)core, (uint8_t)size,
+                        miss ? EVENT_MISS : 0};
+
+  if (h->log->level < (miss ? LOG_MISSES : LOG_ACCESSES))
+    return;
+  memcpy(&record.value, data, size < sizeof(record.value) ? size : sizeof(record.value));
+  logEvent(h->log, &record);
+}
+
+/*------------------------------------------------------------------------------
+Program's access point to the L1 Cache of core: size bytes (1 to
+MAX_ACCESS_SIZE) at any address. An access within one block goes straight
+through; one that crosses blocks is split into an access per block, each
+with its own latencies (and misses), and counted in the L1's splits.
+Returns 0, or -1 if core, size or the address (beyond dram_size) is out of
+range; then nothing is accessed.
+------------------------------------------------------------------------------*/
+int accessSized(Hierarchy *h, uint32_t core, uint64_t address, uint8_t *data, uint32_t size,
+                uint32_t mode) {
+
+  if (core >= h->config.cores || !size || size > MAX_ACCESS_SIZE ||
+      (h->config.dramSize && (size > h->config.dramSize || address > h->config.dramSize - size)))
+    return -1;
+
+  if (h->warmup) {
+    fastForward(h, core, address, data, size, mode);
+    return 0;
+  }
+
+  uint64_t misses = h->l1[core].stats.misses;
+
+  splitL1(h, core, address, data, size, mode);
+
+  if (h->log)
+    logAccess(h, core, address, data, size, mode, h->l1[core].stats.misses != misses);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+One word access of core. Returns 0, or -1 if it is out of range.
+------------------------------------------------------------------------------*/
+int accessL1(Hierarchy *h, uint32_t core, uint64_t address, uint8_t *data, uint32_t mode) {
+  return accessSized(h, core, address, data, WORD_SIZE, mode);
 }
 
 
 
 /*******************************************************************************
- Others.
+ Fast-forward
 *******************************************************************************/
-void read(uint32_t address, uint8_t *data) {
-  accessL1(address, data, MODE_READ);
+
+/* Every cache: the L1s, each followed by its victim cache, then L2, L3, ...
+   Returns how many. */
+static uint32_t listCaches(Hierarchy *h, Cache **caches) {
+
+  uint32_t count = 0;
+
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    caches[count++] = &h->l1[core];
+    if (h->l1[core].victim)
+      caches[count++] = h->l1[core].victim;
+  }
+  for (uint32_t i = 0; i < h->config.levels - 1; i++)
+    caches[count++] = &h->lower[i];
+  return count;
 }
 
-void write(uint32_t address, uint8_t *data) {
-  accessL1(address, data, MODE_WRITE);
+/* Writes every dirty line to the backing store, from the lowest level up, so
+   it ends with the newest copy of every block. */
+static void storeDirtyLines(Hierarchy *h, Cache **caches, uint32_t count) {
+
+  for (uint32_t c = count; c-- > 0;) {
+    Cache *cache = caches[c];
+    const Geometry *geometry = &cache->geometry;
+    size_t lines = (size_t)geometry->sets * geometry->ways;
+
+    for (size_t line = 0; line < lines; line++)
+      if (cache->tags[line] != INVALID_TAG && cache->dirty[line])
+        writeMemory(h->dram, getBlockAddress(geometry, cache->tags[line],
+                                             (uint32_t)(line / geometry->ways)),
+                    lineData(cache, line), geometry->blockSize);
+  }
 }
 
+/* ... and back: every valid line takes the store's copy of its block. */
+static void loadLines(Hierarchy *h, Cache **caches, uint32_t count) {
 
+  for (uint32_t c = 0; c < count; c++) {
+    Cache *cache = caches[c];
+    const Geometry *geometry = &cache->geometry;
+    size_t lines = (size_t)geometry->sets * geometry->ways;
 
+    for (size_t line = 0; line < lines; line++)
+      if (cache->tags[line] != INVALID_TAG)
+        readMemory(h->dram, getBlockAddress(geometry, cache->tags[line],
+                                            (uint32_t)(line / geometry->ways)),
+                   lineData(cache, line), geometry->blockSize);
+  }
+}
+
+/*------------------------------------------------------------------------------
+Before the first fast-forwarded access: drains the write buffers, brings the
+backing store up to date with the caches and sets the detail models aside.
+------------------------------------------------------------------------------*/
+static void setDetailAside(Hierarchy *h) {
+
+  Warmup *w = h->warm;
+  Cache *caches[2 * MAX_CORES + MAX_LEVELS];
+  uint32_t count = listCaches(h, caches);
+
+  flushWriteBuffers(h);
+  if (h->dram)
+    storeDirtyLines(h, caches, count);
+
+  for (uint32_t c = 0; c < count; c++) {
+    w->data[c] = caches[c]->data;
+    w->buffers[c] = caches[c]->buffer;
+    w->prefetchers[c] = caches[c]->prefetcher;
+    caches[c]->data = NULL;
+    caches[c]->buffer = NULL;
+    caches[c]->prefetcher = NULL;
+  }
+  w->dram = h->dram;
+  w->controller = h->controller;
+  w->timing = h->timing;
+  w->log = h->log;
+  w->listener = h->listener;
+  h->dram = NULL;
+  h->controller = NULL;
+  h->timing = NULL;
+  h->log = NULL;
+  h->listener = NULL;
+  w->time = h->time;
+  w->active = 1;
+}
+
+/* Puts the models set aside back, if they are. */
+static void restoreDetail(Hierarchy *h) {
+
+  Warmup *w = h->warm;
+  Cache *caches[2 * MAX_CORES + MAX_LEVELS];
+  uint32_t count = listCaches(h, caches);
+
+  if (!w->active)
+    return;
+
+  for (uint32_t c = 0; c < count; c++) {
+    caches[c]->data = w->data[c];
+    caches[c]->buffer = w->buffers[c];
+    caches[c]->prefetcher = w->prefetchers[c];
+  }
+  h->dram = w->dram;
+  h->controller = w->controller;
+  h->timing = w->timing;
+  h->log = w->log;
+  h->listener = w->listener;
+  w->active = 0;
+}
+
+/*------------------------------------------------------------------------------
+An access while fast-forwarding: the caches update their state through the
+usual paths, with the detail models set aside; a write's value goes to the
+backing store directly, a read returns zeros (as with timing_only). The
+last one ends the warmup.
+------------------------------------------------------------------------------*/
+static void fastForward(Hierarchy *h, uint32_t core, uint64_t address, uint8_t *data,
+                        uint32_t size, uint32_t mode) {
+
+  Warmup *w = h->warm;
+
+  if (!w->active)
+    setDetailAside(h);
+
+  splitL1(h, core, address, data, size, mode);
+  if (w->dram && mode == MODE_WRITE)
+    writeMemory(w->dram, address, data, size);
+
+  w->accesses++;
+  if (--h->warmup == 0)
+    endWarmup(h);
+}
+
+/*------------------------------------------------------------------------------
+Ends the warmup now (if it has not begun, it never will): the detail models
+come back, every line takes its data from the backing store, the clock goes
+back to where it was when the warmup began and the counters restart.
+------------------------------------------------------------------------------*/
+void endWarmup(Hierarchy *h) {
+
+  Cache *caches[2 * MAX_CORES + MAX_LEVELS];
+
+  h->warmup = 0;
+  if (!h->warm || !h->warm->active)
+    return;
+
+  restoreDetail(h);
+  if (h->dram)
+    loadLines(h, caches, listCaches(h, caches));
+  h->time = h->warm->time;
+  clearStats(h);
+}
+
+/*------------------------------------------------------------------------------
+A mark in a trace (with argument): ends the warmup if warmup_mark is set,
+and goes to the event log.
+------------------------------------------------------------------------------*/
+void markTrace(Hierarchy *h, uint64_t argument) {
+  if (h->config.warmupMark)
+    endWarmup(h);
+  if (h->log)
+    logMark(h->log, MARK_TRACE, argument, h->time);
+}
+
+
+
+/*******************************************************************************
+ Shared levels (L2, L3, ...)
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Initializes L2 Cache and every shared level below it.
+------------------------------------------------------------------------------*/
+void initCacheL2(Hierarchy *h) {
+  for (uint32_t i = 0; i < h->config.levels - 1; i++)
+    initLevel(&h->lower[i]);
+}
+
+
+/*------------------------------------------------------------------------------
+Access point of the level above to cache, a shared level: size bytes at
+address, within one block (a whole block for fills and write-backs, less for
+write-throughs). Misses go on to cache->next, DRAM below the last level.
+
+set associative cache, replacement chosen by l2_policy, l3_policy, ...
+------------------------------------------------------------------------------*/
+void accessLevel(Hierarchy *h, Cache *cache, uint64_t address, uint8_t *data, uint32_t size,
+                 uint32_t mode) {
+
+  uint32_t index, offset;
+  uint64_t Tag, MemAddress;
+  uint8_t TempBlock[MAX_BLOCK_SIZE];
+
+  if (h->listener && cache == h->lower)
+    h->listener(h->listenerContext, address, mode);
+
+  const Geometry *geometry = &cache->geometry;
+  Tag = getTag(geometry, address);
+  index = getIndex(geometry, address);
+  offset = getOffset(geometry, address);
+
+  // gets Set of the right index
+  size_t set = (size_t)index * geometry->ways;
+  uint64_t *Tags = &cache->tags[set];
+  int way = findWay(cache, Tags, Tag);
+
+  countAccess(cache, address, mode, way >= 0);
+  int trigger = way < 0;
+
+  /*its a miss*/
+  if (way < 0) {
+    MemAddress = getMemAddress(geometry, address);  // get address of the block in memory
 
+    if (cache->prefetcher)
+      checkPollution(cache, address >> geometry->offsetBits);
+
+    if (mode == MODE_WRITE && !cache->writeAllocate) { // write around the level
+      cache->stats.writesDown++;
+      writeBelow(h, cache, address, data, size);
+      h->time += cache->writeTime;
+      return;
+    }
+
+    /*determine which line from set to replace*/
+    way = (int)chooseVictim(cache, Tags, index);
+
+    drainBlock(h, cache, MemAddress);
+    readNext(h, cache, MemAddress, TempBlock); // access the level below and get block
+
+    cache->stats.evictions += Tags[way] != INVALID_TAG;
+    dropPrefetch(cache, set + way);
+    if (Tags[way] != INVALID_TAG && h->config.inclusion == INCLUSION_INCLUSIVE)
+      backInvalidate(h, cache, set + way, getBlockAddress(geometry, Tags[way], index));
+    if (Tags[way] != INVALID_TAG && cache->dirty[set + way]) { // valid line w dirty block
+      // then write back old block
+      cache->stats.dirtyEvictions++;
+      writeBelow(h, cache, getBlockAddress(geometry, Tags[way], index),
+                 lineData(cache, set + way), geometry->blockSize);
+    }
+
+    if (cache->data)
+      memcpy(lineData(cache, set + way), TempBlock, geometry->blockSize); // copy new block to cache line
+
+    Tags[way] = Tag;
+    cache->dirty[set + way] = 0;
+    cache->stats.fills++;
+    insertLine(&cache->repl, index, (uint32_t)way);
+  }
+  else {
+    touchLine(&cache->repl, index, (uint32_t)way);
+    if (cache->prefetched && cache->prefetched[set + way])
+      trigger = usePrefetch(h, cache, set + way);
+  }
+
+  uint8_t *Data = lineData(cache, set + way);
+
+  if (mode == MODE_READ){ // read block from cache line
+    if (Data)
+      memcpy(data, &Data[offset], size);
+    h->time += cache->readTime;
+  }
+
+  if (mode == MODE_WRITE){ // write block to cache line
+    if (Data && data)
+      memcpy(&Data[offset], data, size);
+    h->time += cache->writeTime;
+    if (cache->writeThrough) {
+      cache->stats.writesDown++;
+      writeBelow(h, cache, address, data, size);
+    }
+    else
+      // it's unsynced w main memory
+      cache->dirty[set + way] = 1;
+  }
+
+  if (cache->prefetcher && mode == MODE_READ) // trained by fills only
+    prefetchAfter(h, cache, address, trigger);
+}
+
+/*------------------------------------------------------------------------------
+Replays a batch of decoded trace accesses through the hierarchy (and its
+marks, through markTrace). Returns count, or the index of the first access
+out of range (see accessSized), where it stopped.
+------------------------------------------------------------------------------*/
+size_t accessBatch(Hierarchy *h, const TraceAccess *batch, size_t count) {
+
+  uint8_t data[MAX_ACCESS_SIZE];
+
+  // a write stores its value in its first bytes, zeros in the rest
+  for (size_t i = 0; i < count; i++) {
+    uint32_t size = batch[i].size;
+    if (batch[i].mode == MODE_MARK) {
+      markTrace(h, batch[i].address);
+      continue;
+    }
+    memcpy(data, &batch[i].value, sizeof(uint32_t));
+    if (size > sizeof(uint32_t))
+      memset(&data[sizeof(uint32_t)], 0, size - sizeof(uint32_t));
+    if (accessSized(h, batch[i].core, batch[i].address, data, size, batch[i].mode) < 0)
+      return i;
+  }
+  return count;
+}
+
+
+
+/*******************************************************************************
+ Default hierarchy, for the single threaded drivers.
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Replaces the default hierarchy with one built from config.
+------------------------------------------------------------------------------*/
+void configureCache(const CacheConfig *config) {
+
+  destroyHierarchy(Default);
+  Default = createHierarchy(config);
+  if (!Default)
+    exit(-1);
+}
+
+Hierarchy *getHierarchy() {
+
+  if (!Default) {
+    CacheConfig defaults;
+    defaultConfig(&defaults);
+    configureCache(&defaults);
+  }
+  return Default;
+}
+
+void resetTime() {
+  Hierarchy *h = getHierarchy();
+  h->time = 0;
+  if (h->timing)
+    resetTiming(h->timing);
+  if (h->controller)
+    resetDram(h->controller);
+}
+
+uint32_t getTime() { return (uint32_t)getHierarchy()->time; }
+
+/*------------------------------------------------------------------------------
+Empties every cache of the default hierarchy; DRAM keeps its contents.
+------------------------------------------------------------------------------*/
+void initCache() {
+  Hierarchy *h = getHierarchy();
+  initCacheL1(h);
+  initCacheL2(h);
+}
+
+// the drivers' interface has no way to report an access out of range
+void read(uint64_t address, uint8_t *data) {
+  if (accessL1(getHierarchy(), 0, address, data, MODE_READ) < 0)
+    exit(-1);
+}
+
+void write(uint64_t address, uint8_t *data) {
+  if (accessL1(getHierarchy(), 0, address, data, MODE_WRITE) < 0)
+    exit(-1);
+}
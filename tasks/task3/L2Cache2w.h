@@ -6,63 +6,137 @@
 #include <string.h>
 #include <stdint.h>
 #include "Cache.h"
-
-#define L1_CACHE_LINES (L1_SIZE / BLOCK_SIZE)
-#define WAYS 2
-#define L2_CACHE_SETS (L2_SIZE / BLOCK_SIZE / WAYS)
-void resetTime();
-
-uint32_t getTime();
+#include "Config.h"
+#include "Dram.h"
+#include "EventLog.h"
+#include "Memory.h"
+#include "Prefetch.h"
+#include "Replacement.h"
+#include "Stats.h"
+#include "Timing.h"
+#include "Trace.h"
+#include "WriteBuffer.h"
+
+#define INVALID_TAG UINT64_MAX   /* tag of an empty way (Valid bit = 0) */
+
+/* One level: sets * ways lines stored set by set, one array per field, so the
+   tags of a set are contiguous. Line i of every array is the same line. */
+typedef struct Cache {
+  Geometry geometry;
+  uint32_t readTime;
+  uint32_t writeTime;
+  uint64_t *tags;    /* INVALID_TAG when the way is empty */
+  uint8_t *dirty;    /* MESI M; for L1s with cores > 1 see shared */
+  uint8_t *shared;   /* L1s with cores > 1: S (1) or E/M (0), else NULL */
+  uint64_t *stale;   /* ... tag invalidated by another core, or INVALID_TAG */
+  Replacement repl;
+  uint32_t writeThrough;   /* WRITE_THROUGH: lines are never dirty */
+  uint32_t writeAllocate;  /* 0: write misses go down without a fill */
+  uint32_t level;          /* 1 for the L1s, 2 for L2, ... */
+  struct Cache *next;      /* the level below, NULL: DRAM */
+  WriteBuffer *buffer;     /* NULL: writes go down synchronously */
+  struct Cache *victim;    /* L1s: victim cache (one set), or NULL */
+  Prefetcher *prefetcher;  /* NULL: no prefetching */
+  uint8_t *prefetched;     /* ... else per line: 1 = prefetched, not used yet */
+  uint64_t *start;         /* ... when its fill begins */
+  uint64_t *ready;         /* ... and when it ends */
+  uint8_t *data;     /* blockSize bytes per line, NULL in timing only mode */
+  LevelStats stats;
+  Classifier *classifier;  /* NULL unless classify_misses is set */
+} Cache;
+
+/* Called with (context, address, mode) on every access that reaches L2. */
+typedef void (*L2Listener)(void *, uint64_t, uint32_t);
+
+/* What a fast-forwarding hierarchy sets aside to run on tags alone (a NULL
+   model is off): the block data, write buffers and prefetchers of its caches
+   (the L1s, each followed by its victim cache, then L2, L3, ...), and its
+   models below. */
+typedef struct Warmup {
+  uint64_t length;        /* config: accesses, UINT64_MAX until a mark */
+  uint64_t accesses;      /* fast-forwarded so far */
+  int active;
+  uint64_t time;          /* h->time when it began */
+  uint8_t **data;         /* per cache */
+  WriteBuffer **buffers;
+  Prefetcher **prefetchers;
+  BackingStore *dram;
+  DramController *controller;
+  Timing *timing;
+  EventLog *log;
+  L2Listener listener;
+} Warmup;
+
+/* A complete, independent hierarchy: config.cores private L1s, the shared
+   levels (L2, L3, ...) and DRAM. */
+typedef struct Hierarchy {
+  CacheConfig config;
+  uint64_t time;
+  BackingStore *dram;  /* NULL in timing only mode */
+  DramController *controller;  /* NULL with dram_model = flat */
+  DramStats dramStats;
+  Cache *l1;           /* one per core */
+  Cache *lower;        /* config.levels - 1 shared levels: L2, L3, ... */
+  L2Listener listener;
+  void *listenerContext;
+  Timing *timing;      /* NULL with timing = serial */
+  EventLog *log;       /* NULL: no event log */
+  uint64_t warmup;     /* accesses still to fast-forward, 0: detailed */
+  Warmup *warm;        /* NULL without warmup and warmup_mark */
+} Hierarchy;
+
+/*********************** Hierarchy *************************/
+
+Hierarchy *createHierarchy(const CacheConfig *);
+
+void destroyHierarchy(Hierarchy *);
+
+void resetHierarchy(Hierarchy *);
+
+void setL2Listener(Hierarchy *, L2Listener, void *);
+
+void setEventLog(Hierarchy *, EventLog *);
+
+void clearStats(Hierarchy *);
+
+uint64_t uniqueBlocks(const Hierarchy *);
 
 /****************  RAM memory (byte addressable) ***************/
-void accessDRAM(uint32_t, uint8_t *, uint32_t);
+void accessDRAM(Hierarchy *, uint64_t, uint8_t *, uint32_t, uint32_t);
 
-/***************** Address manipulation **************/
-uint32_t getOffset(uint32_t);
+/*********************** Cache *************************/
 
-uint32_t getIndex(uint32_t);
+void initCacheL1(Hierarchy *);
+int accessL1(Hierarchy *, uint32_t, uint64_t, uint8_t *, uint32_t);
+int accessSized(Hierarchy *, uint32_t, uint64_t, uint8_t *, uint32_t, uint32_t);
 
-uint32_t getTag(uint32_t);
+void initCacheL2(Hierarchy *);
+void accessLevel(Hierarchy *, Cache *, uint64_t, uint8_t *, uint32_t, uint32_t);
 
-uint32_t getMemAddress(uint32_t);
+void flushWriteBuffers(Hierarchy *);
 
-/*********************** Cache *************************/
+void endWarmup(Hierarchy *);
 
-void initCache();
+void markTrace(Hierarchy *, uint64_t);
 
-void initCacheL1();
-void accessL1(uint32_t, uint8_t *, uint32_t);
+size_t accessBatch(Hierarchy *, const TraceAccess *, size_t);
 
-void initCacheL2();
-void accessL2(uint32_t , uint8_t *, uint32_t);
+/*********************** Default hierarchy *************************/
 
-typedef struct CacheLine {
-  uint8_t Valid;  /*Valid bit: 1 = present, 0 = not present*/
-  uint8_t Dirty;
-  uint32_t Tag;
-  uint32_t Time; /*LRU*/
-  uint8_t Data[BLOCK_SIZE];
-} CacheLine;
+void configureCache(const CacheConfig *);
 
-typedef struct CacheL1 {
-  uint32_t init;
-  CacheLine lines[L1_CACHE_LINES];
-} CacheL1;
+Hierarchy *getHierarchy();
 
-typedef struct Set{
-  CacheLine lines[WAYS];
-} Set;
+void resetTime();
 
-typedef struct CacheL2 {
-  uint32_t init;
-  Set sets[L2_CACHE_SETS];
-} CacheL2;
+uint32_t getTime();
 
+void initCache();
 
 /*********************** Interfaces *************************/
 
-void read(uint32_t, uint8_t *);
+void read(uint64_t, uint8_t *);
 
-void write(uint32_t, uint8_t *);
+void write(uint64_t, uint8_t *);
 
-#endif
\ No newline at end of file
+#endif
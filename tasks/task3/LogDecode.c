@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <string.h>
+#include "EventLog.h"
+#include "Cache.h"
+
+/*------------------------------------------------------------------------------
+Prints a binary event log (EventLog.c) as the text the drivers print.
+
+usage: logdecode [-v] events.bin
+  -v  also print the core, size and L1 miss of each access
+------------------------------------------------------------------------------*/
+
+#define DECODE_BATCH 4096
+
+static void printRecord(const EventRecord *record, int verbose) {
+
+  if (record->kind == EVENT_MARK) {
+    if (record->value == MARK_WORDS)
+      printf("\nNumber of words: %d\n", (int)record->address);
+    else if (record->value == MARK_RANDOM)
+      printf("\nRandom accesses\n");
+    else if (record->value == MARK_TRACE)
+      printf("M %llu\n", (unsigned long long)record->address);
+    return;
+  }
+
+  // the drivers print int addresses, values and times
+  printf("%s; Address %d; Value %d; Time %d", record->kind == MODE_READ ? "Read" : "Write",
+         (int)record->address, (int)record->value, (int)(uint32_t)record->time);
+  if (verbose)
+    printf("; Core %u; Size %u%s", record->core, record->size,
+           record->flags & EVENT_MISS ? "; Miss" : "");
+  putchar('\n');
+}
+
+int main(int argc, char **argv) {
+
+  static EventRecord batch[DECODE_BATCH];
+  EventLogHeader header;
+  const char *path = NULL;
+  int verbose = 0;
+  size_t count;
+  FILE *in;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0)
+      verbose = 1;
+    else
+      path = argv[i];
+  }
+
+  if (!path) {
+    fprintf(stderr, "usage: %s [-v] events.bin\n", argv[0]);
+    return 1;
+  }
+
+  in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, EVENT_LOG_MAGIC, 8) != 0 ||
+      header.version != EVENT_LOG_VERSION || header.recordSize != sizeof(EventRecord)) {
+    fprintf(stderr, "%s: not an event log\n", path);
+    return 1;
+  }
+
+  while ((count = fread(batch, sizeof(EventRecord), DECODE_BATCH, in)) > 0)
+    for (size_t i = 0; i < count; i++)
+      printRecord(&batch[i], verbose);
+
+  if (ferror(in)) {
+    perror(path);
+    return 1;
+  }
+  fclose(in);
+
+  return 0;
+}
@@ -0,0 +1,224 @@
+/*******************************************************************************
+*                                                                              *
+*                      Sparse backing store (DRAM contents)                    *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Holds the contents of main memory for any 64 bit address, allocating only the
+pages that are actually written. Page numbers map to pages through an open
+addressing hash table (linear probing, grown at 50% load); the pages
+themselves come from chunks of ARENA_PAGES, so a trace touching millions of
+pages does not do millions of mallocs. Clearing the store keeps the chunks
+for reuse.
+
+Reads of a page never written return zeros without allocating it, which is
+also what the old flat DRAM array held before the first write.
+
+A restored checkpoint (Checkpoint.c) hands its pages over in place: they stay
+in its private file mapping, read from the page cache on first use and
+copied only when written, until the store is freed.
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "Memory.h"
+
+#define EMPTY_PAGE UINT64_MAX
+
+static inline uint64_t hashPage(uint64_t page) {
+  return (page * 0x9E3779B97F4A7C15ull) >> 20;
+}
+
+/*------------------------------------------------------------------------------
+Returns 0 on success, -1 if out of memory.
+------------------------------------------------------------------------------*/
+int initMemory(BackingStore *m) {
+
+  memset(m, 0, sizeof(*m));
+  m->mask = 1023;
+  m->keys = malloc((m->mask + 1) * sizeof(uint64_t));
+  m->pages = malloc((m->mask + 1) * sizeof(uint8_t *));
+
+  if (!m->keys || !m->pages) {
+    freeMemory(m);
+    return -1;
+  }
+
+  clearMemory(m);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Forgets every page: all of memory reads as zeros again.
+------------------------------------------------------------------------------*/
+void clearMemory(BackingStore *m) {
+  memset(m->keys, 0xFF, (m->mask + 1) * sizeof(uint64_t));
+  m->count = 0;
+  m->chunk = 0;
+  m->used = 0;
+  m->lastKey = EMPTY_PAGE;
+  m->lastPage = NULL;
+}
+
+void freeMemory(BackingStore *m) {
+  if (m->mapping)
+    munmap(m->mapping, m->mappingLength);
+  for (uint32_t i = 0; i < m->numChunks; i++)
+    free(m->chunks[i]);
+  free(m->chunks);
+  free(m->keys);
+  free(m->pages);
+  memset(m, 0, sizeof(*m));
+}
+
+static uint64_t findPage(const BackingStore *m, uint64_t key) {
+  uint64_t slot = hashPage(key) & m->mask;
+  while (m->keys[slot] != EMPTY_PAGE && m->keys[slot] != key)
+    slot = (slot + 1) & m->mask;
+  return slot;
+}
+
+static void growTable(BackingStore *m) {
+
+  uint64_t *keys = m->keys;
+  uint8_t **pages = m->pages;
+  uint64_t size = m->mask + 1;
+
+  m->mask = 2 * size - 1;
+  m->keys = malloc(2 * size * sizeof(uint64_t));
+  m->pages = malloc(2 * size * sizeof(uint8_t *));
+  if (!m->keys || !m->pages)
+    exit(-1);
+  memset(m->keys, 0xFF, 2 * size * sizeof(uint64_t));
+
+  for (uint64_t i = 0; i < size; i++) {
+    if (keys[i] == EMPTY_PAGE)
+      continue;
+    uint64_t slot = findPage(m, keys[i]);
+    m->keys[slot] = keys[i];
+    m->pages[slot] = pages[i];
+  }
+  free(keys);
+  free(pages);
+}
+
+/* A zeroed page from the arena. */
+static uint8_t *carvePage(BackingStore *m) {
+
+  if (m->used == ARENA_PAGES) {
+    m->chunk++;
+    m->used = 0;
+  }
+  if (m->chunk == m->numChunks) {
+    if (m->numChunks == m->maxChunks) {
+      m->maxChunks = m->maxChunks ? 2 * m->maxChunks : 16;
+      m->chunks = realloc(m->chunks, m->maxChunks * sizeof(uint8_t *));
+      if (!m->chunks)
+        exit(-1);
+    }
+    m->chunks[m->numChunks] = malloc((size_t)ARENA_PAGES * MEMORY_PAGE_SIZE);
+    if (!m->chunks[m->numChunks])
+      exit(-1);
+    m->numChunks++;
+  }
+
+  uint8_t *page = &m->chunks[m->chunk][(size_t)m->used++ * MEMORY_PAGE_SIZE];
+  memset(page, 0, MEMORY_PAGE_SIZE); // chunks are reused after clearMemory
+  return page;
+}
+
+/*------------------------------------------------------------------------------
+Page holding address, or NULL if it was never written and create is 0.
+------------------------------------------------------------------------------*/
+static uint8_t *lookupPage(BackingStore *m, uint64_t address, int create) {
+
+  uint64_t key = address >> MEMORY_PAGE_BITS;
+
+  if (key == m->lastKey)
+    return m->lastPage;
+
+  uint64_t slot = findPage(m, key);
+  if (m->keys[slot] == EMPTY_PAGE) {
+    if (!create)
+      return NULL;
+    if (2 * (m->count + 1) > m->mask + 1) {
+      growTable(m);
+      slot = findPage(m, key);
+    }
+    m->keys[slot] = key;
+    m->pages[slot] = carvePage(m);
+    m->count++;
+  }
+
+  m->lastKey = key;
+  m->lastPage = m->pages[slot];
+  return m->lastPage;
+}
+
+/*------------------------------------------------------------------------------
+Copies size bytes at address into data (zeros where nothing was written).
+------------------------------------------------------------------------------*/
+void readMemory(BackingStore *m, uint64_t address, uint8_t *data, uint32_t size) {
+
+  while (size > 0) {
+    uint32_t offset = (uint32_t)(address & (MEMORY_PAGE_SIZE - 1));
+    uint32_t part = MEMORY_PAGE_SIZE - offset < size ? MEMORY_PAGE_SIZE - offset : size;
+    uint8_t *page = lookupPage(m, address, 0);
+
+    if (page)
+      memcpy(data, &page[offset], part);
+    else
+      memset(data, 0, part);
+    address += part;
+    data += part;
+    size -= part;
+  }
+}
+
+void writeMemory(BackingStore *m, uint64_t address, const uint8_t *data, uint32_t size) {
+
+  while (size > 0) {
+    uint32_t offset = (uint32_t)(address & (MEMORY_PAGE_SIZE - 1));
+    uint32_t part = MEMORY_PAGE_SIZE - offset < size ? MEMORY_PAGE_SIZE - offset : size;
+
+    memcpy(&lookupPage(m, address, 1)[offset], data, part);
+    address += part;
+    data += part;
+    size -= part;
+  }
+}
+
+/*------------------------------------------------------------------------------
+Replaces the contents of the store with count pages (page numbers keys, the
+pages one after the other at pages), used where they are: pages lies in
+mapping, which the store now owns and unmaps when freed. Returns 0, or -1 on
+a page number given twice: the store is left empty, and mapping is the
+caller's again.
+------------------------------------------------------------------------------*/
+int adoptPages(BackingStore *m, const uint64_t *keys, uint8_t *pages, uint64_t count,
+               void *mapping, size_t length) {
+
+  clearMemory(m);
+  if (m->mapping)
+    munmap(m->mapping, m->mappingLength);
+  m->mapping = mapping;
+  m->mappingLength = length;
+
+  for (uint64_t i = 0; i < count; i++) {
+    if (2 * (m->count + 1) > m->mask + 1)
+      growTable(m);
+    uint64_t slot = findPage(m, keys[i]);
+    if (m->keys[slot] != EMPTY_PAGE) {
+      clearMemory(m);
+      m->mapping = NULL;
+      m->mappingLength = 0;
+      return -1;
+    }
+    m->keys[slot] = keys[i];
+    m->pages[slot] = pages + i * MEMORY_PAGE_SIZE;
+    m->count++;
+  }
+  return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+#define MEMORY_PAGE_BITS 12
+#define MEMORY_PAGE_SIZE (1u << MEMORY_PAGE_BITS)   /* >= MAX_BLOCK_SIZE */
+#define ARENA_PAGES 256                              /* pages per arena chunk */
+
+/* Sparse byte addressable memory over the full 64 bit address space.
+   Pages are carved from arena chunks on the first write; pages never
+   written read as zeros. */
+typedef struct BackingStore {
+  uint64_t *keys;       /* page numbers, UINT64_MAX = empty (open addressing) */
+  uint8_t **pages;
+  uint64_t mask;
+  uint64_t count;       /* resident pages */
+
+  uint8_t **chunks;     /* ARENA_PAGES pages each, kept across clearMemory */
+  uint32_t numChunks;
+  uint32_t maxChunks;
+  uint32_t chunk;       /* chunk being carved */
+  uint32_t used;        /* pages taken from it */
+
+  uint64_t lastKey;     /* one entry lookup cache */
+  uint8_t *lastPage;
+
+  void *mapping;        /* checkpoint some pages live in (copy on write), or NULL */
+  size_t mappingLength;
+} BackingStore;
+
+int initMemory(BackingStore *);
+
+void clearMemory(BackingStore *);
+
+void freeMemory(BackingStore *);
+
+void readMemory(BackingStore *, uint64_t, uint8_t *, uint32_t);
+
+void writeMemory(BackingStore *, uint64_t, const uint8_t *, uint32_t);
+
+int adoptPages(BackingStore *, const uint64_t *, uint8_t *, uint64_t, void *, size_t);
+
+#endif
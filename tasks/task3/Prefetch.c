@@ -0,0 +1,134 @@
+/*******************************************************************************
+*                                                                              *
+*                      Hardware prefetchers                                    *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Prefetchers watch the demand accesses of one level (as block numbers) and
+propose up to degree blocks to fetch ahead:
+  next    the blocks after a miss, or after the first hit on a prefetched
+          line, so a sequential sweep keeps running ahead
+  stride  a table indexed by page: once the same non-zero stride between two
+          accesses repeats, prefetch along it. Traces carry no instruction
+          pointer, so the page stands in for the usual IP index
+  stream  misses that follow each other within STREAM_WINDOW blocks, up or
+          down, form a stream; after the third, prefetch ahead of it
+
+The hierarchy (L2Cache2w.c) issues the fills in the background and counts
+useful, late, useless and polluting prefetches.
+------------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "Prefetch.h"
+
+const char *const PrefetchNames[] = {"none", "next", "stride", "stream", NULL};
+
+/*------------------------------------------------------------------------------
+offsetBits is log2 of the block size of the level.
+------------------------------------------------------------------------------*/
+void initPrefetcher(Prefetcher *p, PrefetchPolicy policy, uint32_t degree, uint32_t offsetBits) {
+  p->policy = policy;
+  p->degree = degree;
+  p->pageShift = offsetBits < STRIDE_PAGE_BITS ? STRIDE_PAGE_BITS - offsetBits : 0;
+  resetPrefetcher(p);
+}
+
+void resetPrefetcher(Prefetcher *p) {
+  memset(p->stride, 0, sizeof(p->stride));
+  memset(p->stream, 0, sizeof(p->stream));
+  memset(p->evicted, 0, sizeof(p->evicted));
+  memset(p->pending, 0, sizeof(p->pending));
+  p->clock = 0;
+  p->engineFree = 0;
+  p->next = 0;
+}
+
+/* Blocks first + step, first + 2 * step, ... that exist. */
+static uint32_t ahead(const Prefetcher *p, int64_t first, int64_t step, uint64_t *out) {
+
+  uint32_t count = 0;
+
+  for (uint32_t i = 1; i <= p->degree; i++) {
+    int64_t block = first + step * (int64_t)i;
+    if (block >= 0)
+      out[count++] = (uint64_t)block;
+  }
+  return count;
+}
+
+static uint32_t trainStride(Prefetcher *p, uint64_t block, uint64_t *out) {
+
+  uint64_t page = block >> p->pageShift;
+  StrideEntry *entry = &p->stride[page % STRIDE_ENTRIES];
+  int64_t delta = (int64_t)block - entry->last;
+
+  if (entry->page != page + 1) { // new page: start over
+    entry->page = page + 1;
+    entry->last = (int64_t)block;
+    entry->stride = 0;
+    entry->confidence = 0;
+    return 0;
+  }
+
+  if (delta == 0)
+    return 0;
+  if (delta == entry->stride)
+    entry->confidence += entry->confidence < 3;
+  else {
+    entry->stride = delta;
+    entry->confidence = 0;
+  }
+  entry->last = (int64_t)block;
+
+  return entry->confidence >= 1 ? ahead(p, (int64_t)block, entry->stride, out) : 0;
+}
+
+static uint32_t trainStream(Prefetcher *p, uint64_t block, uint64_t *out) {
+
+  int64_t b = (int64_t)block;
+  StreamEntry *oldest = &p->stream[0];
+
+  p->clock++;
+  for (uint32_t i = 0; i < STREAM_ENTRIES; i++) {
+    StreamEntry *stream = &p->stream[i];
+    int64_t delta = b - stream->last;
+
+    if (stream->used && delta != 0 && delta <= STREAM_WINDOW && delta >= -STREAM_WINDOW &&
+        (!stream->direction || (delta > 0) == (stream->direction > 0))) {
+      stream->direction = delta > 0 ? 1 : -1;
+      stream->last = b;
+      stream->length++;
+      stream->used = p->clock;
+      return stream->length >= 2 ? ahead(p, b, stream->direction, out) : 0;
+    }
+    if (stream->used < oldest->used)
+      oldest = stream;
+  }
+
+  oldest->last = b;
+  oldest->direction = 0;
+  oldest->length = 0;
+  oldest->used = p->clock;
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Feeds one demand access to block; trigger says it was a miss or the first
+hit on a prefetched line. Writes the blocks to prefetch to out (at most
+degree) and returns how many.
+------------------------------------------------------------------------------*/
+uint32_t trainPrefetcher(Prefetcher *p, uint64_t block, int trigger, uint64_t *out) {
+
+  switch (p->policy) {
+    case PREFETCH_NONE:
+      return 0;
+    case PREFETCH_NEXT:
+      return trigger ? ahead(p, (int64_t)block, 1, out) : 0;
+    case PREFETCH_STRIDE:
+      return trainStride(p, block, out);
+    case PREFETCH_STREAM:
+      return trigger ? trainStream(p, block, out) : 0;
+  }
+  return 0;
+}
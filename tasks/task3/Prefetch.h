@@ -0,0 +1,62 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+
+#define MAX_PREFETCH_DEGREE 16
+#define STRIDE_ENTRIES 64       /* stride table, direct mapped by page */
+#define STRIDE_PAGE_BITS 12
+#define STREAM_ENTRIES 16       /* streams tracked at once (LRU) */
+#define STREAM_WINDOW 16        /* blocks ahead of a stream that still extend it */
+#define POLLUTION_FILTER 4096   /* blocks recently evicted by prefetches */
+#define PREFETCH_QUEUE 16       /* fills pending at once, more are dropped */
+
+typedef enum PrefetchPolicy {
+  PREFETCH_NONE,
+  PREFETCH_NEXT,     /* next degree blocks after a miss or a first prefetched hit */
+  PREFETCH_STRIDE,   /* constant stride per page, once it repeats */
+  PREFETCH_STREAM    /* ascending or descending runs of misses */
+} PrefetchPolicy;
+
+extern const char *const PrefetchNames[];
+
+typedef struct StrideEntry {
+  uint64_t page;
+  int64_t last;        /* last block */
+  int64_t stride;      /* in blocks */
+  uint32_t confidence;
+} StrideEntry;
+
+typedef struct StreamEntry {
+  int64_t last;        /* last block of the stream */
+  int64_t direction;   /* +1, -1, or 0 until the second miss */
+  uint32_t length;     /* misses that followed the stream */
+  uint64_t used;       /* for LRU */
+} StreamEntry;
+
+/* Prefetcher of one cache level. It only proposes blocks; the hierarchy
+   issues them and tracks what becomes of them. */
+typedef struct Prefetcher {
+  PrefetchPolicy policy;
+  uint32_t degree;
+  uint32_t pageShift;                  /* block number -> stride table page */
+  StrideEntry stride[STRIDE_ENTRIES];
+  StreamEntry stream[STREAM_ENTRIES];
+  uint64_t clock;
+  uint64_t engineFree;                 /* when the previous prefetch fill ends */
+  uint64_t pending[PREFETCH_QUEUE];    /* when the last fills end, oldest at next */
+  uint32_t next;
+  uint64_t evicted[POLLUTION_FILTER];  /* block + 1 evicted by a prefetch, 0 = none */
+} Prefetcher;
+
+void initPrefetcher(Prefetcher *, PrefetchPolicy, uint32_t, uint32_t);
+
+void resetPrefetcher(Prefetcher *);
+
+uint32_t trainPrefetcher(Prefetcher *, uint64_t, int, uint64_t *);
+
+static inline uint32_t pollutionSlot(uint64_t block) {
+  return (uint32_t)((block * 0x9E3779B97F4A7C15ull) >> 52) & (POLLUTION_FILTER - 1);
+}
+
+#endif
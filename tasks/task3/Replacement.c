@@ -0,0 +1,178 @@
+/*******************************************************************************
+*                                                                              *
+*                      Replacement policies                                    *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Victim selection and bookkeeping for one cache level, chosen per level at
+runtime. Empty ways are always filled first by the caller; these functions
+only decide between valid lines.
+
+Hits and fills go through touchLine/insertLine (Replacement.h), which switch
+on the policy instead of calling through a pointer, so the hit path stays
+inline. Per set state is a handful of bytes, and no policy needs a global
+timestamp:
+  LRU     doubly linked list of the ways, most recent first: a hit or fill
+          moves its way to the front and the victim is the last, O(1) each
+  PLRU    binary tree of ways - 1 bits, each pointing to the colder half
+  SRRIP   2 bit re-reference prediction per line, insert at 2, hit sets 0
+  BRRIP   as SRRIP but inserts at 3 except 1 time in 32
+  FIFO    next way to replace, advanced when it is filled
+  RANDOM  xorshift64*, reproducible from the seed
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "Replacement.h"
+
+const char *const ReplacementNames[] = {"lru", "plru", "srrip", "brrip", "fifo", "random", NULL};
+
+/*------------------------------------------------------------------------------
+Allocates the state for sets * ways lines. PLRU needs a power of two number
+of ways. Returns 0 on success, -1 on bad arguments or no memory.
+------------------------------------------------------------------------------*/
+int initReplacement(Replacement *r, ReplacementPolicy policy, uint32_t sets,
+                    uint32_t ways, uint64_t seed) {
+
+  memset(r, 0, sizeof(*r));
+
+  if (!ways || ways > MAX_WAYS || (policy == REPL_PLRU && (ways & (ways - 1))))
+    return -1;
+
+  r->policy = policy;
+  r->sets = sets;
+  r->ways = ways;
+  r->seed = seed ? seed : 0x9E3779B97F4A7C15ull; // xorshift must not start at 0
+  r->state = malloc((size_t)sets * ways);
+  r->newer = policy == REPL_LRU ? malloc((size_t)sets * ways) : NULL;
+  r->tree = malloc((size_t)sets * sizeof(uint64_t));
+
+  if (!r->state || !r->tree || (policy == REPL_LRU && !r->newer)) {
+    freeReplacement(r);
+    return -1;
+  }
+
+  resetReplacement(r);
+  return 0;
+}
+
+void resetReplacement(Replacement *r) {
+
+  for (uint32_t s = 0; s < r->sets; s++) {
+    uint8_t *state = &r->state[(size_t)s * r->ways];
+    for (uint32_t w = 0; w < r->ways; w++)
+      state[w] = RRPV_MAX;
+    r->tree[s] = 0;
+    if (r->policy == REPL_LRU) { // way 0 most recent, ways - 1 the victim
+      uint8_t *newer = &r->newer[(size_t)s * r->ways];
+      for (uint32_t w = 0; w < r->ways; w++) {
+        state[w] = w + 1 < r->ways ? (uint8_t)(w + 1) : NO_WAY;
+        newer[w] = w ? (uint8_t)(w - 1) : NO_WAY;
+      }
+      r->tree[s] = LRU_ENDS(0, r->ways - 1);
+    }
+  }
+  r->random = r->seed;
+}
+
+void freeReplacement(Replacement *r) {
+  free(r->state);
+  free(r->newer);
+  free(r->tree);
+  r->state = NULL;
+  r->newer = NULL;
+  r->tree = NULL;
+}
+
+/*------------------------------------------------------------------------------
+Checks state read from elsewhere (a checkpoint): RRPVs up to RRPV_MAX, FIFO
+ways below ways, PLRU bits within the tree, and every LRU list holding each
+way once, its ends where they say. Returns 0 if the policy can use it.
+------------------------------------------------------------------------------*/
+int checkReplacement(const Replacement *r) {
+
+  uint64_t plruBits = r->ways < 64 ? ((1ull << r->ways) - 1) & ~1ull : ~1ull;
+
+  for (uint32_t s = 0; s < r->sets; s++) {
+    const uint8_t *state = &r->state[(size_t)s * r->ways];
+    uint64_t tree = r->tree[s];
+
+    if (r->policy == REPL_LRU) {
+      const uint8_t *newer = &r->newer[(size_t)s * r->ways];
+      uint64_t seen = 0;
+      uint32_t way = (uint32_t)(tree & 0xFF), previous = NO_WAY;
+
+      if (tree >> 16 || (tree >> 8) >= r->ways)
+        return -1;
+      for (uint32_t i = 0; i < r->ways; i++) {
+        if (way >= r->ways || (seen >> way & 1) || newer[way] != previous)
+          return -1;
+        seen |= 1ull << way;
+        previous = way;
+        way = state[way];
+      }
+      if (way != NO_WAY || previous != (uint32_t)(tree >> 8))
+        return -1;
+      continue;
+    }
+
+    for (uint32_t w = 0; w < r->ways; w++)
+      if (state[w] > RRPV_MAX)
+        return -1;
+    if ((r->policy == REPL_PLRU && (tree & ~plruBits)) ||
+        (r->policy == REPL_FIFO && tree >= r->ways))
+      return -1;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Returns the way to evict from a full set.
+------------------------------------------------------------------------------*/
+uint32_t chooseReplacement(Replacement *r, uint32_t index) {
+
+  uint8_t *state = &r->state[(size_t)index * r->ways];
+
+  switch (r->policy) {
+
+    case REPL_LRU:
+      return (uint32_t)(r->tree[index] >> 8);
+
+    case REPL_PLRU: {
+      uint64_t bits = r->tree[index];
+      uint32_t node = 1, way = 0;
+      for (uint32_t span = r->ways / 2; span > 0; span /= 2) {
+        uint32_t right = (bits >> node) & 1;
+        way |= right ? span : 0;
+        node = 2 * node + right;
+      }
+      return way;
+    }
+
+    case REPL_SRRIP:
+    case REPL_BRRIP: {
+      // age every line by the same amount so the oldest reaches RRPV_MAX
+      uint8_t oldest = 0;
+      uint32_t way = 0;
+      for (uint32_t w = 0; w < r->ways; w++) {
+        if (state[w] > oldest) {
+          oldest = state[w];
+          way = w;
+        }
+      }
+      if (oldest < RRPV_MAX) {
+        for (uint32_t w = 0; w < r->ways; w++)
+          state[w] += RRPV_MAX - oldest;
+      }
+      return way;
+    }
+
+    case REPL_FIFO:
+      return (uint32_t)r->tree[index];
+
+    case REPL_RANDOM:
+      return (uint32_t)(((nextRandom(r) >> 32) * r->ways) >> 32);
+  }
+  return 0;
+}
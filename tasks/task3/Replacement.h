@@ -0,0 +1,134 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_WAYS 64
+
+typedef enum ReplacementPolicy {
+  REPL_LRU,     /* true LRU, a recency list per set */
+  REPL_PLRU,    /* tree pseudo-LRU, ways - 1 bits per set */
+  REPL_SRRIP,   /* static re-reference interval prediction, 2 bit RRPV */
+  REPL_BRRIP,   /* bimodal RRIP: distant insertion, near 1 time in 32 */
+  REPL_FIFO,    /* round robin in fill order */
+  REPL_RANDOM   /* seeded xorshift */
+} ReplacementPolicy;
+
+/* Replacement state of one level, indexed by set (index) and way. */
+typedef struct Replacement {
+  ReplacementPolicy policy;
+  uint32_t sets;
+  uint32_t ways;
+  uint8_t *state;    /* per line: RRPV, or LRU: the next older way */
+  uint8_t *newer;    /* LRU, per line: the next more recent way */
+  uint64_t *tree;    /* per set: PLRU bits, FIFO next way, or LRU ends (LRU_ENDS) */
+  uint64_t random;   /* RANDOM / BRRIP generator state */
+  uint64_t seed;
+} Replacement;
+
+#define RRPV_MAX 3
+#define NO_WAY 0xFF   // end of an LRU list
+
+/* The most recent way of an LRU set, in its low byte, and the least recent. */
+#define LRU_ENDS(head, tail) ((uint64_t)(head) | (uint64_t)(tail) << 8)
+
+extern const char *const ReplacementNames[];
+
+int initReplacement(Replacement *, ReplacementPolicy, uint32_t, uint32_t, uint64_t);
+
+void resetReplacement(Replacement *);
+
+void freeReplacement(Replacement *);
+
+int checkReplacement(const Replacement *);
+
+uint32_t chooseReplacement(Replacement *, uint32_t);
+
+static inline uint64_t nextRandom(Replacement *r) {
+  r->random ^= r->random >> 12;
+  r->random ^= r->random << 25;
+  r->random ^= r->random >> 27;
+  return r->random * 0x2545F4914F6CDD1Dull;
+}
+
+/*------------------------------------------------------------------------------
+Marks way as most recently used (LRU, PLRU), in constant time: an LRU way
+leaves its place in the list and goes to the front.
+------------------------------------------------------------------------------*/
+static inline void promoteLine(Replacement *r, uint32_t index, uint32_t way) {
+
+  if (r->policy == REPL_LRU) {
+    uint8_t *older = &r->state[(size_t)index * r->ways];
+    uint8_t *newer = &r->newer[(size_t)index * r->ways];
+    uint32_t head = (uint32_t)(r->tree[index] & 0xFF), tail = (uint32_t)(r->tree[index] >> 8);
+
+    if (way == head)
+      return;
+    older[newer[way]] = older[way];
+    if (way == tail)
+      tail = newer[way];
+    else
+      newer[older[way]] = newer[way];
+    older[way] = (uint8_t)head;
+    newer[way] = NO_WAY;
+    newer[head] = (uint8_t)way;
+    r->tree[index] = LRU_ENDS(way, tail);
+  }
+  else { // PLRU: every node on the path points away from way
+    uint64_t bits = r->tree[index];
+    uint32_t node = 1;
+    for (uint32_t span = r->ways / 2; span > 0; span /= 2) {
+      uint32_t right = (way & span) != 0;
+      bits = right ? bits & ~(1ull << node) : bits | (1ull << node);
+      node = 2 * node + right;
+    }
+    r->tree[index] = bits;
+  }
+}
+
+/*------------------------------------------------------------------------------
+Records a hit on way.
+------------------------------------------------------------------------------*/
+static inline void touchLine(Replacement *r, uint32_t index, uint32_t way) {
+  switch (r->policy) {
+    case REPL_LRU:
+    case REPL_PLRU:
+      promoteLine(r, index, way);
+      break;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+      r->state[(size_t)index * r->ways + way] = 0;
+      break;
+    case REPL_FIFO:
+    case REPL_RANDOM:
+      break;
+  }
+}
+
+/*------------------------------------------------------------------------------
+Records that a new block was just placed in way.
+------------------------------------------------------------------------------*/
+static inline void insertLine(Replacement *r, uint32_t index, uint32_t way) {
+  switch (r->policy) {
+    case REPL_LRU:
+    case REPL_PLRU:
+      promoteLine(r, index, way);
+      break;
+    case REPL_SRRIP:
+      r->state[(size_t)index * r->ways + way] = RRPV_MAX - 1;
+      break;
+    case REPL_BRRIP:
+      r->state[(size_t)index * r->ways + way] = (nextRandom(r) & 31) ? RRPV_MAX : RRPV_MAX - 1;
+      break;
+    case REPL_FIFO:
+      // a way refilled after an invalidation keeps its turn
+      if (way == r->tree[index])
+        r->tree[index] = (way + 1) % r->ways;
+      break;
+    case REPL_RANDOM:
+      break;
+  }
+}
+
+#endif
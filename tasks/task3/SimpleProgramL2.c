@@ -1,6 +1,28 @@
 #include "L2Cache2w.h"
 
-int main() {
+/*------------------------------------------------------------------------------
+usage: test [-l events.bin]
+  -l events.bin  log every access to a binary event log instead of printing
+                 it (logdecode prints the same text from the log)
+------------------------------------------------------------------------------*/
+
+int main(int argc, char **argv) {
+
+  static EventLog log;
+  EventLog *events = NULL;
+
+  if (argc == 3 && strcmp(argv[1], "-l") == 0) {
+    if (openEventLog(&log, argv[2], LOG_ACCESSES) < 0) {
+      perror(argv[2]);
+      return 1;
+    }
+    events = &log;
+    setEventLog(getHierarchy(), events);
+  }
+  else if (argc != 1) {
+    fprintf(stderr, "usage: %s [-l events.bin]\n", argv[0]);
+    return 1;
+  }
 
   // set seed for random number generator
   srand(0);
@@ -12,23 +34,31 @@ int main() {
     resetTime();
     initCache();
 
-    printf("\nNumber of words: %d\n", (n-1)/WORD_SIZE + 1);
+    if (events)
+      logMark(events, MARK_WORDS, (n-1)/WORD_SIZE + 1, getTime());
+    else
+      printf("\nNumber of words: %d\n", (n-1)/WORD_SIZE + 1);
     
     for(int i = 0; i < n; i+=WORD_SIZE) {
       write(i, (unsigned char *)(&i));
       clock1 = getTime();
-      printf("Write; Address %d; Value %d; Time %d\n", i, i, clock1);
+      if (!events)
+        printf("Write; Address %d; Value %d; Time %d\n", i, i, clock1);
     }
 
     for(int i = 0; i < n; i+=WORD_SIZE) {
       read(i, (unsigned char *)(&value));
       clock1 = getTime();
-      printf("Read; Address %d; Value %d; Time %d\n", i, value, clock1);
+      if (!events)
+        printf("Read; Address %d; Value %d; Time %d\n", i, value, clock1);
     }  
 
   }
 
-  printf("\nRandom accesses\n");
+  if (events)
+    logMark(events, MARK_RANDOM, 0, getTime());
+  else
+    printf("\nRandom accesses\n");
 
   // Do random accesses to the cache
   for(int i = 0; i < 100; i++) {
@@ -38,14 +68,21 @@ int main() {
     if (mode == MODE_READ) {
       read(address, (unsigned char *)(&value));
       clock1 = getTime();
-      printf("Read; Address %d; Value %d; Time %d\n", address, value, clock1);
+      if (!events)
+        printf("Read; Address %d; Value %d; Time %d\n", address, value, clock1);
     }
     else {
       write(address, (unsigned char *)(&address));
       clock1 = getTime();
-      printf("Write; Address %d; Value %d; Time %d\n", address, address, clock1);
+      if (!events)
+        printf("Write; Address %d; Value %d; Time %d\n", address, address, clock1);
     }
   }
+
+  if (events && closeEventLog(events) < 0) {
+    perror(argv[2]);
+    return 1;
+  }
   
   return 0;
 }
\ No newline at end of file
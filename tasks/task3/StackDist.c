@@ -0,0 +1,143 @@
+/*******************************************************************************
+*                                                                              *
+*                  LRU stack distance profiling (Mattson)                      *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+One pass over the L2 reference stream gives hits and misses of every LRU cache
+with 1, 2, 4, ... sets and 1 to maxWays ways.
+
+For a given number of sets, an access hits in a W way LRU cache iff fewer than
+W distinct blocks of the same set were referenced since the previous access to
+that block (its stack distance). Each set keeps its LRU stack down to maxWays
+blocks only, since a deeper distance misses in every profiled cache anyway:
+memory is sets x maxWays blocks whatever the footprint of the stream, and an
+access costs at most maxWays compares per set count.
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "StackDist.h"
+
+
+
+/*******************************************************************************
+Interface
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Profiles caches of blockSize byte blocks with 1..maxSets sets (maxSets a power
+of two) and 1..maxWays ways. Returns 0 on success, -1 on bad arguments or
+no memory (with nothing left allocated).
+------------------------------------------------------------------------------*/
+int initStackProfile(StackProfile *profile, uint32_t blockSize,
+                     uint32_t maxSets, uint32_t maxWays) {
+
+  memset(profile, 0, sizeof(*profile));
+
+  if (!blockSize || (blockSize & (blockSize - 1)) || !maxSets ||
+      (maxSets & (maxSets - 1)) || !maxWays || maxWays > PROFILE_MAX_WAYS)
+    return -1;
+
+  while ((1u << profile->offsetBits) < blockSize)
+    profile->offsetBits++;
+  profile->maxWays = maxWays;
+
+  for (uint32_t sets = 1; sets <= maxSets; sets *= 2)
+    profile->numLevels++;
+
+  profile->levels = calloc(profile->numLevels, sizeof(ProfileLevel));
+  if (!profile->levels) {
+    profile->numLevels = 0;
+    return -1;
+  }
+
+  for (uint32_t l = 0; l < profile->numLevels; l++) {
+    ProfileLevel *level = &profile->levels[l];
+    level->sets = 1u << l;
+    level->stack = malloc((size_t)level->sets * maxWays * sizeof(uint64_t));
+    level->depth = calloc(level->sets, sizeof(uint32_t));
+    if (!level->stack || !level->depth) {
+      freeStackProfile(profile);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Records one reference to the block holding address, for every set count.
+------------------------------------------------------------------------------*/
+void profileAccess(StackProfile *profile, uint64_t address) {
+
+  uint64_t block = address >> profile->offsetBits;
+
+  profile->references++;
+
+  for (uint32_t l = 0; l < profile->numLevels; l++) {
+    ProfileLevel *level = &profile->levels[l];
+    uint32_t set = (uint32_t)(block & (level->sets - 1));
+    uint64_t *stack = &level->stack[(size_t)set * profile->maxWays];
+    uint32_t depth = level->depth[set];
+    uint32_t distance = 0;
+
+    while (distance < depth && stack[distance] != block)
+      distance++;
+
+    if (distance < depth)
+      level->distance[distance]++;
+    else {
+      level->beyond++;
+      // the least recent block falls off a full stack
+      if (depth < profile->maxWays)
+        level->depth[set] = ++depth;
+      distance = depth - 1;
+    }
+
+    memmove(&stack[1], &stack[0], distance * sizeof(uint64_t));
+    stack[0] = block;
+  }
+}
+
+/*------------------------------------------------------------------------------
+Hits of an LRU cache with the given sets and ways over the profiled stream.
+------------------------------------------------------------------------------*/
+uint64_t profileHits(const StackProfile *profile, uint32_t sets, uint32_t ways) {
+
+  uint64_t hits = 0;
+
+  for (uint32_t l = 0; l < profile->numLevels; l++) {
+    const ProfileLevel *level = &profile->levels[l];
+    if (level->sets != sets)
+      continue;
+    for (uint32_t d = 0; d < ways && d < profile->maxWays; d++)
+      hits += level->distance[d];
+  }
+  return hits;
+}
+
+void printStackProfile(FILE *out, const StackProfile *profile) {
+
+  fprintf(out, "References %llu\n", (unsigned long long)profile->references);
+
+  for (uint32_t l = 0; l < profile->numLevels; l++) {
+    uint32_t sets = profile->levels[l].sets;
+    for (uint32_t ways = 1; ways <= profile->maxWays; ways++) {
+      uint64_t hits = profileHits(profile, sets, ways);
+      fprintf(out, "Sets %u; Ways %u; Size %llu; Hits %llu; Misses %llu\n", sets, ways,
+              (unsigned long long)sets * ways << profile->offsetBits,
+              (unsigned long long)hits, (unsigned long long)(profile->references - hits));
+    }
+  }
+}
+
+void freeStackProfile(StackProfile *profile) {
+
+  for (uint32_t l = 0; l < profile->numLevels; l++) {
+    free(profile->levels[l].stack);
+    free(profile->levels[l].depth);
+  }
+  free(profile->levels);
+  memset(profile, 0, sizeof(*profile));
+}
@@ -0,0 +1,36 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PROFILE_MAX_WAYS 64
+
+/* All sets of one set count, plus its stack distance histogram. */
+typedef struct ProfileLevel {
+  uint32_t sets;
+  uint64_t *stack;                        /* per set, maxWays blocks, most recent first */
+  uint32_t *depth;                        /* per set, blocks in its stack */
+  uint64_t distance[PROFILE_MAX_WAYS];    /* distance d: hit from d + 1 ways up */
+  uint64_t beyond;                        /* cold or deeper than maxWays */
+} ProfileLevel;
+
+typedef struct StackProfile {
+  uint32_t offsetBits;
+  uint32_t maxWays;
+  uint32_t numLevels;
+  ProfileLevel *levels;  /* set counts 1, 2, 4, ... */
+  uint64_t references;
+} StackProfile;
+
+int initStackProfile(StackProfile *, uint32_t, uint32_t, uint32_t);
+
+void profileAccess(StackProfile *, uint64_t);
+
+uint64_t profileHits(const StackProfile *, uint32_t, uint32_t);
+
+void printStackProfile(FILE *, const StackProfile *);
+
+void freeStackProfile(StackProfile *);
+
+#endif
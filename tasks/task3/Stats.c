@@ -0,0 +1,360 @@
+/*******************************************************************************
+*                                                                              *
+*                      Statistics and 3C miss classification                   *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Each level counts its own reads, writes, hits, misses, fills and evictions
+(see LevelStats); this file exports them and classifies misses.
+
+A miss is compulsory if the block was never referenced before, a conflict
+miss if a fully associative LRU cache with the same number of lines would
+have hit, and a capacity miss otherwise. The shadow cache is a hash table
+plus a doubly linked LRU list, O(1) per access.
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "L2Cache2w.h"
+
+#define EMPTY_BLOCK UINT64_MAX
+
+static inline uint64_t hashBlock(uint64_t block) {
+  return (block * 0x9E3779B97F4A7C15ull) >> 17;
+}
+
+
+
+/*******************************************************************************
+Seen blocks
+*******************************************************************************/
+
+static void growSeen(Classifier *c) {
+
+  uint64_t *old = c->seen;
+  uint64_t oldSize = old ? c->seenMask + 1 : 0;
+  uint64_t size = oldSize ? 2 * oldSize : 4096;
+
+  c->seen = malloc(size * sizeof(uint64_t));
+  if (!c->seen)
+    exit(-1);
+  memset(c->seen, 0xFF, size * sizeof(uint64_t));
+  c->seenMask = size - 1;
+
+  for (uint64_t i = 0; i < oldSize; i++) {
+    if (old[i] == EMPTY_BLOCK)
+      continue;
+    uint64_t slot = hashBlock(old[i]) & c->seenMask;
+    while (c->seen[slot] != EMPTY_BLOCK)
+      slot = (slot + 1) & c->seenMask;
+    c->seen[slot] = old[i];
+  }
+  free(old);
+}
+
+/*------------------------------------------------------------------------------
+Adds block to the seen set. Returns 1 if it was not there yet.
+------------------------------------------------------------------------------*/
+static int markSeen(Classifier *c, uint64_t block) {
+
+  if (2 * (c->seenCount + 1) > c->seenMask + 1)
+    growSeen(c);
+
+  uint64_t slot = hashBlock(block) & c->seenMask;
+  while (c->seen[slot] != EMPTY_BLOCK) {
+    if (c->seen[slot] == block)
+      return 0;
+    slot = (slot + 1) & c->seenMask;
+  }
+  c->seen[slot] = block;
+  c->seenCount++;
+  return 1;
+}
+
+
+
+/*******************************************************************************
+Shadow fully associative LRU cache
+*******************************************************************************/
+
+static uint32_t findSlot(const Classifier *c, uint64_t block) {
+  uint32_t slot = (uint32_t)hashBlock(block) & c->tableMask;
+  while (c->table[slot] && c->blocks[c->table[slot] - 1] != block)
+    slot = (slot + 1) & c->tableMask;
+  return slot;
+}
+
+/*------------------------------------------------------------------------------
+Removes a slot from the linear probing table, shifting back the entries
+that would otherwise become unreachable.
+------------------------------------------------------------------------------*/
+static void removeSlot(Classifier *c, uint32_t slot) {
+
+  uint32_t next = slot;
+
+  for (;;) {
+    next = (next + 1) & c->tableMask;
+    if (!c->table[next])
+      break;
+    uint32_t home = (uint32_t)hashBlock(c->blocks[c->table[next] - 1]) & c->tableMask;
+    // move next into the hole unless its home lies cyclically in (slot, next]
+    if ((next > slot && (home <= slot || home > next)) ||
+        (next < slot && home <= slot && home > next)) {
+      c->table[slot] = c->table[next];
+      slot = next;
+    }
+  }
+  c->table[slot] = 0;
+}
+
+static void unlinkNode(Classifier *c, uint32_t node) {
+  if (c->prev[node] != NO_NODE)
+    c->next[c->prev[node]] = c->next[node];
+  else
+    c->head = c->next[node];
+  if (c->next[node] != NO_NODE)
+    c->prev[c->next[node]] = c->prev[node];
+  else
+    c->tail = c->prev[node];
+}
+
+static void pushFront(Classifier *c, uint32_t node) {
+  c->prev[node] = NO_NODE;
+  c->next[node] = c->head;
+  if (c->head != NO_NODE)
+    c->prev[c->head] = node;
+  c->head = node;
+  if (c->tail == NO_NODE)
+    c->tail = node;
+}
+
+/*------------------------------------------------------------------------------
+References block in the shadow cache. Returns 1 on a shadow hit.
+------------------------------------------------------------------------------*/
+static int shadowAccess(Classifier *c, uint64_t block) {
+
+  uint32_t slot = findSlot(c, block);
+  uint32_t node;
+
+  if (c->table[slot]) {
+    node = c->table[slot] - 1;
+    unlinkNode(c, node);
+    pushFront(c, node);
+    return 1;
+  }
+
+  if (c->count < c->capacity)
+    node = c->count++;
+  else { // reuse the LRU node
+    node = c->tail;
+    unlinkNode(c, node);
+    removeSlot(c, findSlot(c, c->blocks[node]));
+    slot = findSlot(c, block);
+  }
+
+  c->blocks[node] = block;
+  c->table[slot] = node + 1;
+  pushFront(c, node);
+  return 0;
+}
+
+
+
+/*******************************************************************************
+Interface
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Prepares a classifier for a level of the given number of lines.
+Returns 0 on success, -1 if out of memory.
+------------------------------------------------------------------------------*/
+int initClassifier(Classifier *c, uint32_t lines) {
+
+  uint32_t tableSize = 1;
+
+  memset(c, 0, sizeof(*c));
+  while (tableSize < 2 * lines)
+    tableSize *= 2;
+
+  c->capacity = lines;
+  c->tableMask = tableSize - 1;
+  c->blocks = malloc(lines * sizeof(uint64_t));
+  c->prev = malloc(lines * sizeof(uint32_t));
+  c->next = malloc(lines * sizeof(uint32_t));
+  c->table = malloc(tableSize * sizeof(uint32_t));
+
+  if (!c->blocks || !c->prev || !c->next || !c->table) {
+    freeClassifier(c);
+    return -1;
+  }
+
+  resetClassifier(c);
+  return 0;
+}
+
+void resetClassifier(Classifier *c) {
+  c->count = 0;
+  c->head = NO_NODE;
+  c->tail = NO_NODE;
+  memset(c->table, 0, ((size_t)c->tableMask + 1) * sizeof(uint32_t));
+  free(c->seen);
+  c->seen = NULL;
+  c->seenCount = 0;
+  c->seenMask = 0;
+}
+
+void freeClassifier(Classifier *c) {
+  free(c->blocks);
+  free(c->prev);
+  free(c->next);
+  free(c->table);
+  free(c->seen);
+  memset(c, 0, sizeof(*c));
+}
+
+/*------------------------------------------------------------------------------
+Feeds one reference to block (hit says whether the real level hit) and
+returns MISS_HIT or the kind of miss.
+------------------------------------------------------------------------------*/
+uint32_t classifyAccess(Classifier *c, uint64_t block, uint32_t hit) {
+
+  int first = markSeen(c, block);
+  int shadowHit = shadowAccess(c, block);
+
+  if (hit)
+    return MISS_HIT;
+  if (first)
+    return MISS_COMPULSORY;
+  return shadowHit ? MISS_CONFLICT : MISS_CAPACITY;
+}
+
+
+
+/*******************************************************************************
+Export
+*******************************************************************************/
+
+static void writeLevelJson(FILE *out, const char *name, const LevelStats *s) {
+  fprintf(out, "{\"name\":\"%s\",\"reads\":%llu,\"writes\":%llu,\"hits\":%llu,"
+          "\"misses\":%llu,\"fills\":%llu,\"evictions\":%llu,\"dirty_evictions\":%llu,"
+          "\"writes_down\":%llu,\"splits\":%llu,\"coalesced\":%llu,\"buffer_stall\":%llu,"
+          "\"victim_hits\":%llu,\"victim_conflicts\":%llu,"
+          "\"invalidations\":%llu,\"upgrades\":%llu,\"coherence_misses\":%llu,"
+          "\"coherence_writebacks\":%llu,\"prefetch_issued\":%llu,\"prefetch_useful\":%llu,"
+          "\"prefetch_late\":%llu,\"prefetch_useless\":%llu,\"prefetch_polluting\":%llu,"
+          "\"mshr_merged\":%llu,\"mshr_stall\":%llu,\"back_invalidations\":%llu,"
+          "\"compulsory\":%llu,\"capacity\":%llu,\"conflict\":%llu}", name,
+          (unsigned long long)s->reads, (unsigned long long)s->writes,
+          (unsigned long long)s->hits, (unsigned long long)s->misses,
+          (unsigned long long)s->fills, (unsigned long long)s->evictions,
+          (unsigned long long)s->dirtyEvictions, (unsigned long long)s->writesDown,
+          (unsigned long long)s->splits,
+          (unsigned long long)s->coalesced, (unsigned long long)s->bufferStall,
+          (unsigned long long)s->victimHits, (unsigned long long)s->victimConflicts,
+          (unsigned long long)s->invalidations,
+          (unsigned long long)s->upgrades, (unsigned long long)s->coherenceMisses,
+          (unsigned long long)s->coherenceWritebacks, (unsigned long long)s->prefetchIssued,
+          (unsigned long long)s->prefetchUseful, (unsigned long long)s->prefetchLate,
+          (unsigned long long)s->prefetchUseless, (unsigned long long)s->prefetchPolluting,
+          (unsigned long long)s->mshrMerged, (unsigned long long)s->mshrStall,
+          (unsigned long long)s->backInvalidations,
+          (unsigned long long)s->compulsory,
+          (unsigned long long)s->capacity, (unsigned long long)s->conflict);
+}
+
+/* "L1" with one core, "L1.<core>" with several. */
+static const char *l1Name(const Hierarchy *h, uint32_t core, char *name, size_t size) {
+  if (h->config.cores == 1)
+    return "L1";
+  snprintf(name, size, "L1.%u", core);
+  return name;
+}
+
+/*------------------------------------------------------------------------------
+One JSON object (on one line) with every counter of the hierarchy.
+------------------------------------------------------------------------------*/
+void writeStatsJson(FILE *out, const Hierarchy *h, uint64_t accesses) {
+
+  const DramStats *d = &h->dramStats;
+  char name[16];
+
+  fprintf(out, "{\"accesses\":%llu,\"time\":%llu,\"unique_blocks\":%llu,\"levels\":[",
+          (unsigned long long)accesses, (unsigned long long)h->time,
+          (unsigned long long)uniqueBlocks(h));
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    writeLevelJson(out, l1Name(h, core, name, sizeof(name)), &h->l1[core].stats);
+    fputc(',', out);
+  }
+  for (uint32_t i = 0; i < h->config.levels - 1; i++) {
+    snprintf(name, sizeof(name), "L%u", h->lower[i].level);
+    writeLevelJson(out, name, &h->lower[i].stats);
+    if (i + 2 < h->config.levels)
+      fputc(',', out);
+  }
+  fprintf(out, "],\"dram\":{\"reads\":%llu,\"writes\":%llu,\"read_bytes\":%llu,"
+          "\"write_bytes\":%llu,\"row_hits\":%llu,\"row_misses\":%llu,"
+          "\"row_conflicts\":%llu}}\n",
+          (unsigned long long)d->reads, (unsigned long long)d->writes,
+          (unsigned long long)d->readBytes, (unsigned long long)d->writeBytes,
+          (unsigned long long)d->rowHits, (unsigned long long)d->rowMisses,
+          (unsigned long long)d->rowConflicts);
+}
+
+void writeStatsCsvHeader(FILE *out) {
+  fprintf(out, "accesses,time,level,reads,writes,hits,misses,fills,evictions,"
+          "dirty_evictions,writes_down,splits,coalesced,buffer_stall,victim_hits,victim_conflicts,"
+          "invalidations,upgrades,"
+          "coherence_misses,coherence_writebacks,prefetch_issued,prefetch_useful,prefetch_late,"
+          "prefetch_useless,prefetch_polluting,mshr_merged,mshr_stall,"
+          "back_invalidations,compulsory,capacity,conflict,"
+          "read_bytes,write_bytes,row_hits,row_misses,row_conflicts,unique_blocks\n");
+}
+
+static void writeLevelCsv(FILE *out, const Hierarchy *h, uint64_t accesses, uint64_t unique,
+                          const char *name, const LevelStats *s) {
+  fprintf(out, "%llu,%llu,%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,"
+          "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,,,,,,%llu\n",
+          (unsigned long long)accesses, (unsigned long long)h->time, name,
+          (unsigned long long)s->reads, (unsigned long long)s->writes,
+          (unsigned long long)s->hits, (unsigned long long)s->misses,
+          (unsigned long long)s->fills, (unsigned long long)s->evictions,
+          (unsigned long long)s->dirtyEvictions, (unsigned long long)s->writesDown,
+          (unsigned long long)s->splits,
+          (unsigned long long)s->coalesced, (unsigned long long)s->bufferStall,
+          (unsigned long long)s->victimHits, (unsigned long long)s->victimConflicts,
+          (unsigned long long)s->invalidations,
+          (unsigned long long)s->upgrades, (unsigned long long)s->coherenceMisses,
+          (unsigned long long)s->coherenceWritebacks, (unsigned long long)s->prefetchIssued,
+          (unsigned long long)s->prefetchUseful, (unsigned long long)s->prefetchLate,
+          (unsigned long long)s->prefetchUseless, (unsigned long long)s->prefetchPolluting,
+          (unsigned long long)s->mshrMerged, (unsigned long long)s->mshrStall,
+          (unsigned long long)s->backInvalidations,
+          (unsigned long long)s->compulsory,
+          (unsigned long long)s->capacity, (unsigned long long)s->conflict,
+          (unsigned long long)unique);
+}
+
+/*------------------------------------------------------------------------------
+One CSV row per level plus one for DRAM, matching writeStatsCsvHeader.
+------------------------------------------------------------------------------*/
+void writeStatsCsv(FILE *out, const Hierarchy *h, uint64_t accesses) {
+
+  const DramStats *d = &h->dramStats;
+  uint64_t unique = uniqueBlocks(h);
+  char name[16];
+
+  for (uint32_t core = 0; core < h->config.cores; core++)
+    writeLevelCsv(out, h, accesses, unique, l1Name(h, core, name, sizeof(name)),
+                  &h->l1[core].stats);
+  for (uint32_t i = 0; i < h->config.levels - 1; i++) {
+    snprintf(name, sizeof(name), "L%u", h->lower[i].level);
+    writeLevelCsv(out, h, accesses, unique, name, &h->lower[i].stats);
+  }
+  fprintf(out, "%llu,%llu,DRAM,%llu,%llu,,,,,,,,,,,,,,,,,,,,,,,,,,,%llu,%llu,%llu,%llu,%llu,%llu\n",
+          (unsigned long long)accesses, (unsigned long long)h->time,
+          (unsigned long long)d->reads, (unsigned long long)d->writes,
+          (unsigned long long)d->readBytes, (unsigned long long)d->writeBytes,
+          (unsigned long long)d->rowHits, (unsigned long long)d->rowMisses,
+          (unsigned long long)d->rowConflicts, (unsigned long long)unique);
+}
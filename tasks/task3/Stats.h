@@ -0,0 +1,109 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Counters of one cache level. Plain increments, always on. */
+typedef struct LevelStats {
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t fills;
+  uint64_t evictions;       /* valid lines replaced */
+  uint64_t dirtyEvictions;  /* ... that had to be written back */
+  uint64_t writesDown;      /* write-throughs and writes that did not allocate */
+  uint64_t splits;          /* L1s: accesses that crossed blocks, one access per block */
+  uint64_t coalesced;       /* writes merged into a queued write buffer entry */
+  uint64_t bufferStall;     /* cycles waiting for the write buffer to drain */
+  uint64_t victimHits;      /* misses served by the victim cache */
+  uint64_t victimConflicts; /* ... that were conflict misses (classify_misses) */
+
+  /* MESI, private L1s with cores > 1 only */
+  uint64_t invalidations;        /* lines lost to another core's write */
+  uint64_t upgrades;             /* writes to S lines (S -> M) */
+  uint64_t coherenceMisses;      /* misses on a line lost to an invalidation */
+  uint64_t coherenceWritebacks;  /* M lines written back for another core */
+
+  /* Prefetching (l1_prefetch/l2_prefetch). Accuracy is useful / issued,
+     coverage useful / (useful + misses). */
+  uint64_t prefetchIssued;     /* blocks fetched by the prefetcher */
+  uint64_t prefetchUseful;     /* ... hit by a demand access */
+  uint64_t prefetchLate;       /* ... that was still waiting for the fill */
+  uint64_t prefetchUseless;    /* ... evicted without being used */
+  uint64_t prefetchPolluting;  /* misses on lines a prefetch had evicted */
+
+  /* MSHRs, timing = event only */
+  uint64_t mshrMerged;   /* accesses to a block whose fill was outstanding */
+  uint64_t mshrStall;    /* cycles misses waited for a free MSHR */
+
+  /* inclusion = inclusive only */
+  uint64_t backInvalidations;  /* lines dropped because a lower level evicted their block */
+
+  /* 3C classification, only counted with classify_misses = 1 */
+  uint64_t compulsory;
+  uint64_t capacity;
+  uint64_t conflict;
+} LevelStats;
+
+typedef struct DramStats {
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t readBytes;
+  uint64_t writeBytes;
+  uint64_t rowHits;       /* dram_model = banked only */
+  uint64_t rowMisses;
+  uint64_t rowConflicts;
+} DramStats;
+
+#define NO_NODE UINT32_MAX   // end of the classifier's LRU list
+
+/* Shadow fully associative LRU cache of the same capacity as a level, plus
+   the set of every block ever referenced, to tell the 3Cs apart. */
+typedef struct Classifier {
+  uint32_t capacity;   /* lines */
+  uint32_t count;
+  uint64_t *blocks;    /* per node */
+  uint32_t *prev;
+  uint32_t *next;
+  uint32_t head;       /* most recently used node */
+  uint32_t tail;
+  uint32_t *table;     /* block -> node + 1, 0 = empty (linear probing) */
+  uint32_t tableMask;
+
+  uint64_t *seen;      /* blocks referenced so far (open addressing) */
+  uint64_t seenCount;
+  uint64_t seenMask;
+} Classifier;
+
+#define MISS_HIT 0
+#define MISS_COMPULSORY 1
+#define MISS_CAPACITY 2
+#define MISS_CONFLICT 3
+
+int initClassifier(Classifier *, uint32_t);
+
+void resetClassifier(Classifier *);
+
+void freeClassifier(Classifier *);
+
+uint32_t classifyAccess(Classifier *, uint64_t, uint32_t);
+
+static inline void countMiss(LevelStats *stats, uint32_t kind) {
+  stats->compulsory += kind == MISS_COMPULSORY;
+  stats->capacity += kind == MISS_CAPACITY;
+  stats->conflict += kind == MISS_CONFLICT;
+}
+
+/*********************** Export *************************/
+
+struct Hierarchy;
+
+void writeStatsJson(FILE *, const struct Hierarchy *, uint64_t);
+
+void writeStatsCsvHeader(FILE *);
+
+void writeStatsCsv(FILE *, const struct Hierarchy *, uint64_t);
+
+#endif
@@ -0,0 +1,234 @@
+#include <time.h>
+#include "L2Cache2w.h"
+#include "WorkPool.h"
+
+/*------------------------------------------------------------------------------
+Design space sweep: replays one trace through every configuration of a
+parameter grid, all configurations in parallel on a work-stealing pool.
+
+usage: sweep [-f config] [-o key=value]... [-g key=v1,v2,...]... [-j workers] trace
+  -f config          base configuration file
+  -o key=value       override one option of the base configuration
+  -g key=v1,v2,...   grid axis: the sweep covers every combination of axes
+  -j workers         worker threads (default: one per online CPU)
+
+The trace is decoded once into a single array that every worker replays
+read-only, so memory does not grow with the number of workers.
+------------------------------------------------------------------------------*/
+
+#define MAX_AXES 16
+#define MAX_VALUES 64
+
+typedef struct Axis {
+  char key[32];
+  char values[MAX_VALUES][32];
+  uint32_t count;
+} Axis;
+
+typedef struct Point {
+  CacheConfig config;
+  const TraceAccess *trace;
+  size_t accesses;
+  uint32_t index;      /* position in the grid */
+  int valid;           /* passed checkConfig, has the trace's cores, and ran */
+  uint64_t time;
+  double l1MissRate;
+  double l2MissRate;
+  double seconds;
+} Point;
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*------------------------------------------------------------------------------
+Splits "key=v1,v2,..." into an axis. Returns 0 on success.
+------------------------------------------------------------------------------*/
+static int parseAxis(Axis *axis, const char *text) {
+
+  const char *equals = strchr(text, '=');
+  const char *p;
+  size_t length;
+
+  if (!equals || (size_t)(equals - text) >= sizeof(axis->key))
+    return -1;
+
+  memcpy(axis->key, text, (size_t)(equals - text));
+  axis->key[equals - text] = '\0';
+  axis->count = 0;
+
+  for (p = equals + 1; *p; p += length + (p[length] == ',')) {
+    length = strcspn(p, ",");
+    if (length == 0 || length >= sizeof(axis->values[0]) || axis->count == MAX_VALUES)
+      return -1;
+    memcpy(axis->values[axis->count], p, length);
+    axis->values[axis->count][length] = '\0';
+    axis->count++;
+  }
+  return axis->count ? 0 : -1;
+}
+
+static double missRate(const LevelStats *stats) {
+  uint64_t total = stats->hits + stats->misses;
+  return total ? (double)stats->misses / total : 0.0;
+}
+
+static void runPoint(void *argument) {
+
+  Point *point = argument;
+  Hierarchy *h = createHierarchy(&point->config);
+  double start = seconds();
+
+  if (!h) {
+    point->valid = 0;
+    return;
+  }
+
+  if (accessBatch(h, point->trace, point->accesses) < point->accesses) { // out of range
+    point->valid = 0;
+    destroyHierarchy(h);
+    return;
+  }
+  flushWriteBuffers(h);
+
+  point->time = h->time;
+  LevelStats l1 = {0};
+  for (uint32_t core = 0; core < h->config.cores; core++) {
+    l1.hits += h->l1[core].stats.hits;
+    l1.misses += h->l1[core].stats.misses;
+  }
+  point->l1MissRate = missRate(&l1);
+  point->l2MissRate = missRate(&h->lower[0].stats);
+  point->seconds = seconds() - start;
+  destroyHierarchy(h);
+}
+
+int main(int argc, char **argv) {
+
+  static Axis axes[MAX_AXES];
+  uint32_t numAxes = 0, workers = defaultWorkers();
+  const char *path = NULL;
+  CacheConfig base;
+  TraceAccess *trace;
+  size_t accesses;
+  uint32_t cores = 1;
+  uint64_t steals;
+
+  defaultConfig(&base);
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      if (loadConfig(&base, argv[++i]) < 0)
+        return 1;
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      if (setConfigOption(&base, argv[++i]) < 0) {
+        fprintf(stderr, "invalid option: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+      if (numAxes == MAX_AXES || parseAxis(&axes[numAxes++], argv[++i]) < 0) {
+        fprintf(stderr, "invalid grid axis: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      workers = (uint32_t)atoi(argv[++i]);
+    else
+      path = argv[i];
+  }
+
+  if (!path) {
+    fprintf(stderr, "usage: %s [-f config] [-o key=value]... [-g key=v1,v2,...]... "
+            "[-j workers] trace\n", argv[0]);
+    return 1;
+  }
+
+  trace = loadTrace(path, &accesses);
+  if (!trace) {
+    perror(path);
+    return 1;
+  }
+  for (size_t i = 0; i < accesses; i++)
+    if (trace[i].core >= cores)
+      cores = trace[i].core + 1u;
+
+  /* expand the grid, last axis varying fastest */
+  uint32_t numPoints = 1;
+  for (uint32_t a = 0; a < numAxes; a++)
+    numPoints *= axes[a].count;
+
+  Point *points = calloc(numPoints, sizeof(Point));
+  WorkItem *items = calloc(numPoints, sizeof(WorkItem));
+  uint32_t numItems = 0;
+  if (!points || !items)
+    exit(-1);
+
+  for (uint32_t p = 0; p < numPoints; p++) {
+    Point *point = &points[p];
+    uint32_t rest = p;
+    char option[80];
+
+    point->config = base;
+    point->trace = trace;
+    point->accesses = accesses;
+    point->index = p;
+    point->valid = 1;
+
+    for (uint32_t a = numAxes; a-- > 0;) {
+      snprintf(option, sizeof(option), "%s=%s", axes[a].key, axes[a].values[rest % axes[a].count]);
+      rest /= axes[a].count;
+      if (setConfigOption(&point->config, option) < 0) {
+        fprintf(stderr, "invalid option: %s\n", option);
+        return 1;
+      }
+    }
+
+    if (checkConfig(&point->config) < 0 || point->config.cores < cores) {
+      point->valid = 0;
+      continue;
+    }
+    items[numItems].function = runPoint;
+    items[numItems].argument = point;
+    numItems++;
+  }
+
+  double start = seconds();
+  workers = runWork(items, numItems, workers, &steals);
+  double elapsed = seconds() - start;
+
+  /* one consolidated table, in grid order */
+  for (uint32_t a = 0; a < numAxes; a++)
+    printf("%-14s ", axes[a].key);
+  printf("%14s %10s %10s %10s %10s\n", "time", "cycles/acc", "l1_miss", "l2_miss", "host_s");
+
+  for (uint32_t p = 0; p < numPoints; p++) {
+    uint32_t rest = p, value[MAX_AXES];
+
+    for (uint32_t a = numAxes; a-- > 0;) {
+      value[a] = rest % axes[a].count;
+      rest /= axes[a].count;
+    }
+    for (uint32_t a = 0; a < numAxes; a++)
+      printf("%-14s ", axes[a].values[value[a]]);
+
+    if (!points[p].valid)
+      printf("%14s\n", "invalid");
+    else
+      printf("%14llu %10.3f %10.4f %10.4f %10.3f\n", (unsigned long long)points[p].time,
+             accesses ? (double)points[p].time / accesses : 0.0,
+             points[p].l1MissRate, points[p].l2MissRate,
+             points[p].seconds);
+  }
+
+  printf("Configurations %u; Accesses %zu; Workers %u; Steals %llu; Host time %.3f s\n",
+         numItems, accesses, workers, (unsigned long long)steals, elapsed);
+
+  free(items);
+  free(points);
+  free(trace);
+  return 0;
+}
@@ -0,0 +1,228 @@
+/*******************************************************************************
+*                                                                              *
+*                      Event driven timing                                     *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Building blocks of the non-blocking timing model (timing = event): a
+priority queue of events and the MSHR files of the levels.
+
+A miss takes an MSHR of its level until its fill arrives; the release of
+each entry is an event in the level's queue, so the entry a new miss gets is
+the one that frees first, and when none is free yet the miss waits for that
+event. A later miss to a block that is still being filled merges into its
+entry instead (findMshr).
+
+Accesses are scheduled one at a time, in trace order, against these queues
+by the hierarchy (L2Cache2w.c).
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "Timing.h"
+
+const char *const TimingNames[] = {"serial", "event", NULL};
+
+
+
+/*******************************************************************************
+Event queue
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Room for capacity events. Returns 0 on success, -1 if out of memory.
+------------------------------------------------------------------------------*/
+int initEventQueue(EventQueue *queue, uint32_t capacity) {
+  queue->events = malloc(capacity * sizeof(Event));
+  queue->count = 0;
+  queue->capacity = capacity;
+  return queue->events ? 0 : -1;
+}
+
+void freeEventQueue(EventQueue *queue) {
+  free(queue->events);
+  memset(queue, 0, sizeof(*queue));
+}
+
+static inline int earlier(const Event *a, const Event *b) {
+  return a->time < b->time || (a->time == b->time && a->id < b->id);
+}
+
+/*------------------------------------------------------------------------------
+Adds an event (the queue must not be full).
+------------------------------------------------------------------------------*/
+void pushEvent(EventQueue *queue, uint64_t time, uint32_t id) {
+
+  Event event = {time, id};
+  uint32_t i = queue->count++;
+
+  while (i > 0 && earlier(&event, &queue->events[(i - 1) / 2])) {
+    queue->events[i] = queue->events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  queue->events[i] = event;
+}
+
+/*------------------------------------------------------------------------------
+Removes and returns the earliest event (the queue must not be empty).
+------------------------------------------------------------------------------*/
+Event popEvent(EventQueue *queue) {
+
+  Event first = queue->events[0];
+  Event last = queue->events[--queue->count];
+  uint32_t i = 0;
+
+  for (;;) {
+    uint32_t child = 2 * i + 1;
+    if (child >= queue->count)
+      break;
+    if (child + 1 < queue->count && earlier(&queue->events[child + 1], &queue->events[child]))
+      child++;
+    if (!earlier(&queue->events[child], &last))
+      break;
+    queue->events[i] = queue->events[child];
+    i = child;
+  }
+  if (queue->count)
+    queue->events[i] = last;
+  return first;
+}
+
+
+
+/*******************************************************************************
+MSHRs
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Returns 0 on success, -1 if out of memory.
+------------------------------------------------------------------------------*/
+int initMshrFile(MshrFile *mshrs, uint32_t entries) {
+
+  memset(mshrs, 0, sizeof(*mshrs));
+  mshrs->capacity = entries;
+  mshrs->blocks = malloc(entries * sizeof(uint64_t));
+  mshrs->ready = malloc(entries * sizeof(uint64_t));
+
+  if (!mshrs->blocks || !mshrs->ready || initEventQueue(&mshrs->release, entries) < 0) {
+    freeMshrFile(mshrs);
+    return -1;
+  }
+
+  resetMshrFile(mshrs);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Every entry free since time 0.
+------------------------------------------------------------------------------*/
+void resetMshrFile(MshrFile *mshrs) {
+  mshrs->release.count = 0;
+  for (uint32_t i = 0; i < mshrs->capacity; i++) {
+    mshrs->blocks[i] = UINT64_MAX;
+    mshrs->ready[i] = 0;
+    pushEvent(&mshrs->release, 0, i);
+  }
+}
+
+void freeMshrFile(MshrFile *mshrs) {
+  free(mshrs->blocks);
+  free(mshrs->ready);
+  freeEventQueue(&mshrs->release);
+  memset(mshrs, 0, sizeof(*mshrs));
+}
+
+/*------------------------------------------------------------------------------
+Entry still filling block (a block address) at time now, or -1.
+------------------------------------------------------------------------------*/
+int findMshr(const MshrFile *mshrs, uint64_t block, uint64_t now) {
+  for (uint32_t i = 0; i < mshrs->capacity; i++) {
+    if (mshrs->blocks[i] == block && mshrs->ready[i] > now)
+      return (int)i;
+  }
+  return -1;
+}
+
+/*------------------------------------------------------------------------------
+Takes the entry that frees first for a miss at *when, which is moved to when
+the entry is free if that is later. completeMshr must follow.
+------------------------------------------------------------------------------*/
+uint32_t allocateMshr(MshrFile *mshrs, uint64_t *when) {
+
+  Event release = popEvent(&mshrs->release);
+
+  if (release.time > *when)
+    *when = release.time;
+  return release.id;
+}
+
+/*------------------------------------------------------------------------------
+The fill of block held by entry arrives at ready, which frees the entry.
+------------------------------------------------------------------------------*/
+void completeMshr(MshrFile *mshrs, uint32_t entry, uint64_t block, uint64_t ready) {
+  mshrs->blocks[entry] = block;
+  mshrs->ready[entry] = ready;
+  pushEvent(&mshrs->release, ready, entry);
+}
+
+
+
+/*******************************************************************************
+Timing
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+cores L1 MSHR files of l1Entries and one per shared level, of lowerEntries[i]
+for level i + 2. Returns 0 on success, -1 if out of memory.
+------------------------------------------------------------------------------*/
+int initTiming(Timing *timing, uint32_t cores, uint32_t l1Entries,
+               const uint32_t *lowerEntries, uint32_t shared) {
+
+  memset(timing, 0, sizeof(*timing));
+  timing->clock = calloc(cores, sizeof(uint64_t));
+  timing->l1 = calloc(cores, sizeof(MshrFile));
+  timing->lower = calloc(shared, sizeof(MshrFile));
+  if (!timing->clock || !timing->l1 || !timing->lower) {
+    freeTiming(timing);
+    return -1;
+  }
+
+  for (; timing->cores < cores; timing->cores++) {
+    if (initMshrFile(&timing->l1[timing->cores], l1Entries) < 0) {
+      freeTiming(timing);
+      return -1;
+    }
+  }
+  for (; timing->shared < shared; timing->shared++) {
+    if (initMshrFile(&timing->lower[timing->shared], lowerEntries[timing->shared]) < 0) {
+      freeTiming(timing);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Back to time 0 with no miss outstanding.
+------------------------------------------------------------------------------*/
+void resetTiming(Timing *timing) {
+  for (uint32_t core = 0; core < timing->cores; core++) {
+    timing->clock[core] = 0;
+    resetMshrFile(&timing->l1[core]);
+  }
+  for (uint32_t i = 0; i < timing->shared; i++)
+    resetMshrFile(&timing->lower[i]);
+  timing->finish = 0;
+}
+
+void freeTiming(Timing *timing) {
+  for (uint32_t core = 0; core < timing->cores; core++)
+    freeMshrFile(&timing->l1[core]);
+  for (uint32_t i = 0; i < timing->shared; i++)
+    freeMshrFile(&timing->lower[i]);
+  free(timing->clock);
+  free(timing->l1);
+  free(timing->lower);
+  memset(timing, 0, sizeof(*timing));
+}
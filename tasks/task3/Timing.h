@@ -0,0 +1,85 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+#define MAX_MSHRS 64   // outstanding misses per level
+
+typedef enum TimingModel {
+  TIMING_SERIAL,   /* every latency adds to one global time, misses never overlap */
+  TIMING_EVENT     /* non-blocking caches: misses overlap up to the MSHR limits */
+} TimingModel;
+
+extern const char *const TimingNames[];
+
+typedef struct Event {
+  uint64_t time;
+  uint32_t id;
+} Event;
+
+/* Binary min-heap of events, earliest first (ties: lowest id). */
+typedef struct EventQueue {
+  Event *events;
+  uint32_t count;
+  uint32_t capacity;
+} EventQueue;
+
+/* Miss status holding registers of one level. An entry tracks one block
+   being filled; the queue holds every entry keyed by when it frees up. */
+typedef struct MshrFile {
+  uint32_t capacity;
+  uint64_t *blocks;    /* per entry: block address */
+  uint64_t *ready;     /* per entry: when the fill arrives and it frees */
+  EventQueue release;
+} MshrFile;
+
+/* Event timing state of a hierarchy. */
+typedef struct Timing {
+  uint32_t cores;
+  uint64_t *clock;     /* per core: when it issues its next access */
+  MshrFile *l1;        /* per core */
+  MshrFile *lower;     /* per shared level: L2, L3, ... */
+  uint32_t shared;
+  uint64_t finish;     /* latest completion so far */
+  int l1Miss;          /* set by the access being timed: it filled L1 ... */
+  uint32_t missed;     /* ... from the shared level after that many misses
+                          (config.levels - 1: from DRAM) */
+  int fill;            /* while that fill is being read from L2 */
+  uint64_t l1Ready;    /* ... it hit a prefetched line whose fill arrives then */
+  uint64_t l2Ready;
+  uint32_t background; /* > 0 while a prefetch fill or buffer drain runs */
+} Timing;
+
+/*********************** Event queue *************************/
+
+int initEventQueue(EventQueue *, uint32_t);
+
+void freeEventQueue(EventQueue *);
+
+void pushEvent(EventQueue *, uint64_t, uint32_t);
+
+Event popEvent(EventQueue *);
+
+/*********************** MSHRs *************************/
+
+int initMshrFile(MshrFile *, uint32_t);
+
+void resetMshrFile(MshrFile *);
+
+void freeMshrFile(MshrFile *);
+
+int findMshr(const MshrFile *, uint64_t, uint64_t);
+
+uint32_t allocateMshr(MshrFile *, uint64_t *);
+
+void completeMshr(MshrFile *, uint32_t, uint64_t, uint64_t);
+
+/*********************** Timing *************************/
+
+int initTiming(Timing *, uint32_t, uint32_t, const uint32_t *, uint32_t);
+
+void resetTiming(Timing *);
+
+void freeTiming(Timing *);
+
+#endif
@@ -0,0 +1,868 @@
+/*******************************************************************************
+*                                                                              *
+*                      Trace-driven front end                                  *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Streams a trace file from disk and decodes it into batches of TraceAccess.
+
+The file is memory mapped and read sequentially; every TRACE_WINDOW bytes the
+part already decoded is dropped from the mapping, so memory use stays constant
+no matter how large the trace is.
+
+Three formats are accepted:
+  - text: the lines printed by the drivers ("Read; Address 4; Value 4; ...")
+    or the short form "R <address>" / "W <address> <value>" (decimal or 0x),
+    where the letter may carry the access width in bytes ("R8", "W32": one
+    word otherwise); any other line is ignored.
+  - binary: a TraceHeader followed by TraceRecords.
+  - packed: a PackHeader, then blocks of variable length records, each block
+    checksummed (CRC-32C) and decodable on its own, then an index of the
+    blocks, so a reader can seek to any access (seekTrace).
+A line "M [argument]" (mode MODE_MARK in binary traces) marks a point in
+the trace, e.g. the end of a warmup (warmup_mark), rather than an access.
+
+A TraceMerge reads one trace per core and interleaves them round robin,
+quantum accesses at a time, tagging each access with its core. The order
+depends only on the traces and the quantum, so multicore runs repeat exactly.
+------------------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE4_2__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#include "Cache.h"
+#include "Config.h"
+#include "Trace.h"
+
+static int openPacked(TraceFile *);
+
+
+
+/*******************************************************************************
+Opening and closing
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Maps the trace and detects its format from the header.
+Returns 0 on success, -1 on error (errno is set).
+------------------------------------------------------------------------------*/
+int openTrace(TraceFile *trace, const char *path) {
+
+  struct stat info;
+
+  memset(trace, 0, sizeof(*trace));
+  trace->fd = open(path, O_RDONLY);
+  if (trace->fd < 0)
+    return -1;
+
+  if (fstat(trace->fd, &info) < 0) {
+    close(trace->fd);
+    return -1;
+  }
+
+  trace->length = (size_t)info.st_size;
+  trace->format = TRACE_TEXT;
+
+  if (trace->length == 0) // nothing to map, every batch will be empty
+    return 0;
+
+  trace->map = mmap(NULL, trace->length, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+  if (trace->map == MAP_FAILED) {
+    trace->map = NULL;
+    close(trace->fd);
+    return -1;
+  }
+  madvise((void *)trace->map, trace->length, MADV_SEQUENTIAL);
+
+  if (trace->length >= sizeof(TraceHeader) &&
+      memcmp(trace->map, TRACE_MAGIC, 8) == 0) {
+    TraceHeader header;
+    memcpy(&header, trace->map, sizeof(header));
+    if (header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+      closeTrace(trace);
+      errno = EINVAL;
+      return -1;
+    }
+    trace->format = TRACE_BINARY;
+    trace->cursor = sizeof(TraceHeader);
+  }
+  else if (trace->length >= sizeof(PackHeader) + sizeof(PackTrailer) &&
+           memcmp(trace->map, PACK_MAGIC, 8) == 0 && openPacked(trace) < 0) {
+    closeTrace(trace);
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+void closeTrace(TraceFile *trace) {
+  if (trace->map)
+    munmap((void *)trace->map, trace->length);
+  if (trace->fd >= 0)
+    close(trace->fd);
+  trace->map = NULL;
+  trace->fd = -1;
+}
+
+/*------------------------------------------------------------------------------
+Drops the already decoded part of the mapping once it exceeds TRACE_WINDOW.
+------------------------------------------------------------------------------*/
+static void releaseConsumed(TraceFile *trace) {
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t consumed = trace->cursor - trace->released;
+
+  if (consumed < TRACE_WINDOW)
+    return;
+
+  consumed &= ~(page - 1); // released stays page aligned
+  madvise((void *)(trace->map + trace->released), consumed, MADV_DONTNEED);
+  trace->released += consumed;
+}
+
+
+
+/*******************************************************************************
+Text decoding
+*******************************************************************************/
+
+static const uint8_t *skipBlanks(const uint8_t *p, const uint8_t *end) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+/*------------------------------------------------------------------------------
+Parses a signed decimal or 0x prefixed hexadecimal number.
+Returns the position after the number, or NULL if there is none.
+------------------------------------------------------------------------------*/
+static const uint8_t *parseNumber(const uint8_t *p, const uint8_t *end, uint64_t *out) {
+
+  int negative = 0;
+  uint64_t value = 0;
+  const uint8_t *start;
+
+  if (p < end && *p == '-') {
+    negative = 1;
+    p++;
+  }
+
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    p += 2;
+    start = p;
+    for (; p < end; p++) {
+      uint8_t c = *p;
+      if (c >= '0' && c <= '9')
+        value = (value << 4) | (uint64_t)(c - '0');
+      else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        value = (value << 4) | (uint64_t)((c | 0x20) - 'a' + 10);
+      else
+        break;
+    }
+  } else {
+    start = p;
+    while (p < end && *p >= '0' && *p <= '9')
+      value = value * 10 + (uint64_t)(*p++ - '0');
+  }
+
+  if (p == start)
+    return NULL;
+
+  *out = negative ? (uint64_t)(-(int64_t)value) : value;
+  return p;
+}
+
+/*------------------------------------------------------------------------------
+Finds "key" inside [p, end) and parses the number that follows it.
+------------------------------------------------------------------------------*/
+static const uint8_t *parseField(const uint8_t *p, const uint8_t *end,
+                                 const char *key, uint64_t *out) {
+
+  size_t keyLength = strlen(key);
+
+  for (; p + keyLength <= end; p++) {
+    if (*p == key[0] && memcmp(p, key, keyLength) == 0)
+      return parseNumber(skipBlanks(p + keyLength, end), end, out);
+  }
+  return NULL;
+}
+
+/*------------------------------------------------------------------------------
+Decodes one text line. Returns 1 if it describes an access, 0 otherwise.
+------------------------------------------------------------------------------*/
+static int parseLine(const uint8_t *p, const uint8_t *end, TraceAccess *access) {
+
+  uint64_t address, value = 0;
+
+  access->core = 0;
+  access->size = WORD_SIZE;
+  p = skipBlanks(p, end);
+  if (p == end)
+    return 0;
+
+  /* long form, as printed by SimpleProgramL2 */
+  if (end - p >= 5 && (memcmp(p, "Read;", 5) == 0 || memcmp(p, "READ;", 5) == 0)) {
+    if (!parseField(p + 5, end, "Address", &address))
+      return 0;
+    access->mode = MODE_READ;
+    access->address = address;
+    access->value = 0;
+    return 1;
+  }
+  if (end - p >= 6 && memcmp(p, "Write;", 6) == 0) {
+    const uint8_t *q = parseField(p + 6, end, "Address", &address);
+    if (!q)
+      return 0;
+    parseField(q, end, "Value", &value);
+    access->mode = MODE_WRITE;
+    access->address = address;
+    access->value = (uint32_t)value;
+    return 1;
+  }
+
+  /* mark: M [argument], in address */
+  if (*p == 'M' || *p == 'm') {
+    address = 0;
+    if (p + 1 < end && p[1] != ' ' && p[1] != '\t')
+      return 0;
+    parseNumber(skipBlanks(p + 1, end), end, &address);
+    access->mode = MODE_MARK;
+    access->address = address;
+    access->value = 0;
+    return 1;
+  }
+
+  /* short form: R[size] <address> | W[size] <address> [value] */
+  switch (*p) {
+    case 'R': case 'r':
+      access->mode = MODE_READ;
+      break;
+    case 'W': case 'w':
+      access->mode = MODE_WRITE;
+      break;
+    default:
+      return 0;
+  }
+
+  uint32_t size = 0;
+  while (++p < end && *p >= '0' && *p <= '9' && size <= MAX_ACCESS_SIZE)
+    size = size * 10 + (uint32_t)(*p - '0');
+  if (p == end || (*p != ' ' && *p != '\t') || size > MAX_ACCESS_SIZE)
+    return 0;
+  if (size)
+    access->size = (uint8_t)size;
+
+  p = parseNumber(skipBlanks(p, end), end, &address);
+  if (!p)
+    return 0;
+  parseNumber(skipBlanks(p, end), end, &value);
+
+  access->address = address;
+  access->value = (uint32_t)value;
+  return 1;
+}
+
+static size_t nextTextBatch(TraceFile *trace, TraceAccess *batch, size_t max) {
+
+  const uint8_t *end = trace->map + trace->length;
+  const uint8_t *p = trace->map + trace->cursor;
+  size_t count = 0;
+
+  while (count < max && p < end) {
+    const uint8_t *eol = memchr(p, '\n', (size_t)(end - p));
+    if (!eol)
+      eol = end;
+
+    trace->line++;
+    count += (size_t)parseLine(p, eol, &batch[count]);
+    p = eol < end ? eol + 1 : end;
+  }
+
+  trace->cursor = (size_t)(p - trace->map);
+  return count;
+}
+
+
+
+/*******************************************************************************
+Binary decoding
+*******************************************************************************/
+
+/* A record with an unknown mode, a size over MAX_ACCESS_SIZE or a core over
+   MAX_CORES ends the trace (trace->error is EILSEQ). */
+static size_t nextBinaryBatch(TraceFile *trace, TraceAccess *batch, size_t max) {
+
+  size_t available = (trace->length - trace->cursor) / sizeof(TraceRecord);
+  size_t count = available < max ? available : max;
+  const uint8_t *p = trace->map + trace->cursor;
+
+  for (size_t i = 0; i < count; i++, p += sizeof(TraceRecord)) {
+    TraceRecord record;
+    memcpy(&record, p, sizeof(record));
+    if (record.mode > MODE_MARK || record.size > MAX_ACCESS_SIZE || record.core >= MAX_CORES) {
+      trace->error = EILSEQ;
+      trace->cursor = trace->length;
+      return i;
+    }
+    batch[i].address = record.address;
+    batch[i].value = record.value;
+    batch[i].mode = record.mode;
+    batch[i].core = record.core;
+    batch[i].size = record.size ? record.size : WORD_SIZE;
+  }
+
+  trace->cursor += count * sizeof(TraceRecord);
+  return count;
+}
+
+
+
+/*******************************************************************************
+Packed decoding
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+A packed record starts with an op byte: its low 2 bits are MODE_WRITE,
+MODE_READ, MODE_MARK or PACK_SWITCH. An access goes on with the difference
+to the previous address of the block, zigzag coded, in 1 to 8 bytes (bits 2
+to 4 of the op byte: bytes - 1), then, for a write, its value in 0 to 4
+bytes (bits 5 to 7); a mark with its argument, like an address delta. So
+the op byte alone gives the length of a record, and the decoder needs no
+continuation bit per byte. A switch is not an access: the byte after it is
+the core (PACK_CORE in bits 2 to 7), below MAX_CORES, or the size (PACK_SIZE)
+of the accesses that follow. Every block starts from address 0, core 0 and WORD_SIZE.
+------------------------------------------------------------------------------*/
+
+#define PACK_SWITCH 3
+#define PACK_CORE 0
+#define PACK_SIZE 1
+
+/* CRC-32C, with the SSE 4.2 instruction where there is one. */
+static uint32_t checksum(const uint8_t *p, size_t length) {
+
+  uint32_t crc = ~0u;
+
+#if defined(__SSE4_2__)
+  for (; length >= 8; length -= 8, p += 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    crc = (uint32_t)_mm_crc32_u64(crc, word);
+  }
+  for (; length; length--)
+    crc = _mm_crc32_u8(crc, *p++);
+#else
+  for (; length; length--) {
+    crc ^= *p++;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0x82F63B78u & -(crc & 1));
+  }
+#endif
+  return ~crc;
+}
+
+/* The little endian number in the bytes (1 to 8) at p, read as one word. */
+static inline uint64_t getBytes(const uint8_t *p, uint32_t bytes) {
+  uint64_t word;
+  memcpy(&word, p, 8);
+  return word & (~0ull >> (64 - 8 * bytes));
+}
+
+/* Checks the header and trailer of a packed trace. Returns 0 if they fit. */
+static int openPacked(TraceFile *trace) {
+
+  PackHeader header;
+  PackTrailer trailer;
+  size_t end = trace->length - sizeof(PackTrailer);
+
+  memcpy(&header, trace->map, sizeof(header));
+  memcpy(&trailer, trace->map + end, sizeof(trailer));
+  if (header.version != PACK_VERSION || memcmp(trailer.magic, PACK_MAGIC, 8) != 0 ||
+      trailer.indexOffset < sizeof(PackHeader) || trailer.indexOffset > end ||
+      trailer.blocks != (end - trailer.indexOffset) / sizeof(PackIndexEntry) ||
+      (end - trailer.indexOffset) % sizeof(PackIndexEntry))
+    return -1;
+
+  trace->format = TRACE_PACKED;
+  trace->indexOffset = (size_t)trailer.indexOffset;
+  trace->blocks = trailer.blocks;
+  trace->cursor = sizeof(PackHeader);
+  trace->blockEnd = trace->cursor;
+  return 0;
+}
+
+/* Starts the block at the cursor, once its checksum matches. Returns 0, or
+   -1 at the end of the blocks or on a bad one (trace->error is set). */
+static int openBlock(TraceFile *trace) {
+
+  PackBlock block;
+
+  if (trace->cursor >= trace->indexOffset)
+    return -1;
+  if (trace->indexOffset - trace->cursor < sizeof(block))
+    goto corrupt;
+
+  memcpy(&block, trace->map + trace->cursor, sizeof(block));
+  trace->cursor += sizeof(block);
+  if (block.bytes > trace->indexOffset - trace->cursor ||
+      checksum(trace->map + trace->cursor, block.bytes) != block.checksum)
+    goto corrupt;
+
+  trace->blockEnd = trace->cursor + block.bytes;
+  trace->previous = 0;
+  trace->core = 0;
+  trace->size = WORD_SIZE;
+  return 0;
+
+corrupt:
+  trace->error = EILSEQ;
+  trace->cursor = trace->blockEnd = trace->indexOffset;
+  return -1;
+}
+
+static size_t nextPackedBatch(TraceFile *trace, TraceAccess *batch, size_t max) {
+
+  size_t count = 0;
+
+  while (count < max) {
+    if (trace->cursor == trace->blockEnd && openBlock(trace) < 0)
+      break;
+
+    // a record may be read past the end of a bad block, but not past the
+    // index and trailer that follow the blocks
+    const uint8_t *p = trace->map + trace->cursor;
+    const uint8_t *end = trace->map + trace->blockEnd;
+    uint64_t previous = trace->previous;
+    uint8_t core = trace->core, size = trace->size;
+
+    while (count < max && p < end) {
+      TraceAccess *access = &batch[count];
+      uint32_t op = *p;
+      uint32_t bytes = ((op >> 2) & 7) + 1, valueBytes = op >> 5;
+
+      if ((op & 3) == PACK_SWITCH) {
+        if (op >> 2 == PACK_CORE && p[1] < MAX_CORES)
+          core = p[1];
+        else if (op >> 2 == PACK_SIZE && p[1] && p[1] <= MAX_ACCESS_SIZE)
+          size = p[1];
+        else
+          break;
+        p += 2;
+        continue;
+      }
+
+      uint64_t field = getBytes(p + 1, bytes);
+      access->mode = (uint8_t)(op & 3);
+      access->core = core;
+      if (access->mode == MODE_MARK) {
+        access->address = field;
+        access->value = 0;
+        access->size = WORD_SIZE;
+      }
+      else {
+        uint32_t value;
+        memcpy(&value, p + 1 + bytes, 4);
+        previous += (field >> 1) ^ -(field & 1);
+        access->address = previous;
+        access->size = size;
+        access->value = (uint32_t)(value & ((1ull << 8 * valueBytes) - 1));
+      }
+      p += 1 + bytes + valueBytes;
+      count++;
+    }
+
+    if (p > end || (p < end && count < max)) { // a record does not fit its block
+      trace->error = EILSEQ;
+      trace->cursor = trace->blockEnd = trace->indexOffset;
+      break;
+    }
+    trace->cursor = (size_t)(p - trace->map);
+    trace->previous = previous;
+    trace->core = core;
+    trace->size = size;
+  }
+  return count;
+}
+
+
+
+/*******************************************************************************
+Interface
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Decodes up to max accesses into batch. Returns 0 once the trace is exhausted.
+------------------------------------------------------------------------------*/
+size_t nextTraceBatch(TraceFile *trace, TraceAccess *batch, size_t max) {
+
+  size_t count;
+
+  if (!trace->map)
+    return 0;
+
+  if (trace->format == TRACE_BINARY)
+    count = nextBinaryBatch(trace, batch, max);
+  else if (trace->format == TRACE_PACKED)
+    count = nextPackedBatch(trace, batch, max);
+  else
+    count = nextTextBatch(trace, batch, max);
+
+  releaseConsumed(trace);
+  return count;
+}
+
+/*------------------------------------------------------------------------------
+Positions trace so the next access decoded is number access (from 0, marks
+included): straight there in a binary trace, from the block the index points
+to in a packed one, by decoding from the start in a text one.
+Returns 0 on success, -1 if the trace is shorter or bad (errno is set).
+------------------------------------------------------------------------------*/
+int seekTrace(TraceFile *trace, uint64_t access) {
+
+  TraceAccess skipped[TRACE_BATCH_SIZE];
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uint64_t left = access;
+
+  trace->error = 0;
+  if (trace->format == TRACE_BINARY) {
+    if (access > (trace->length - sizeof(TraceHeader)) / sizeof(TraceRecord)) {
+      errno = EINVAL;
+      return -1;
+    }
+    trace->cursor = sizeof(TraceHeader) + access * sizeof(TraceRecord);
+    left = 0;
+  }
+  else if (trace->format == TRACE_PACKED) {
+    PackIndexEntry entry = {sizeof(PackHeader), 0};
+    uint64_t low = 0, high = trace->blocks;
+
+    while (low < high) { // the last block starting at or before access
+      uint64_t middle = (low + high) / 2;
+      PackIndexEntry probe;
+      memcpy(&probe, trace->map + trace->indexOffset + middle * sizeof(probe), sizeof(probe));
+      if (probe.first <= access) {
+        entry = probe;
+        low = middle + 1;
+      }
+      else
+        high = middle;
+    }
+    if (entry.offset < sizeof(PackHeader) || entry.offset > trace->indexOffset) {
+      errno = EILSEQ;
+      return -1;
+    }
+    trace->cursor = trace->blockEnd = (size_t)entry.offset;
+    left = access - entry.first;
+  }
+  else {
+    trace->cursor = 0;
+    trace->line = 0;
+  }
+  trace->released = trace->cursor & ~(page - 1);
+
+  while (left > 0) {
+    size_t n = nextTraceBatch(trace, skipped, left < TRACE_BATCH_SIZE ? left : TRACE_BATCH_SIZE);
+    if (!n) {
+      errno = trace->error ? trace->error : EINVAL;
+      return -1;
+    }
+    left -= n;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Decodes a whole trace into one array, e.g. to share it read-only between
+threads. Returns NULL on error (errno is set); free() the result.
+------------------------------------------------------------------------------*/
+TraceAccess *loadTrace(const char *path, size_t *count) {
+
+  TraceFile trace;
+  TraceAccess *accesses = NULL;
+  size_t capacity = 0, n;
+
+  if (openTrace(&trace, path) < 0)
+    return NULL;
+
+  *count = 0;
+  do {
+    if (capacity - *count < TRACE_BATCH_SIZE) {
+      capacity = capacity ? 2 * capacity : 16 * TRACE_BATCH_SIZE;
+      TraceAccess *grown = realloc(accesses, capacity * sizeof(TraceAccess));
+      if (!grown) {
+        free(accesses);
+        closeTrace(&trace);
+        errno = ENOMEM;
+        return NULL;
+      }
+      accesses = grown;
+    }
+    n = nextTraceBatch(&trace, &accesses[*count], TRACE_BATCH_SIZE);
+    *count += n;
+  } while (n > 0);
+
+  closeTrace(&trace);
+  if (trace.error) {
+    free(accesses);
+    errno = trace.error;
+    return NULL;
+  }
+  return accesses;
+}
+
+/*------------------------------------------------------------------------------
+Opens one trace per core. With a single trace the cores recorded in it are
+kept. Returns 0 on success, -1 on error (errno is set, and merge->count is
+the index of the trace that could not be opened).
+------------------------------------------------------------------------------*/
+int openTraceMerge(TraceMerge *merge, const char *const *paths, uint32_t count,
+                   uint32_t quantum) {
+
+  memset(merge, 0, sizeof(*merge));
+  merge->streams = calloc(count, sizeof(TraceStream));
+  if (!merge->streams) {
+    errno = ENOMEM;
+    return -1;
+  }
+  merge->quantum = quantum ? quantum : 1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (openTrace(&merge->streams[i].file, paths[i]) < 0) {
+      closeTraceMerge(merge);
+      return -1;
+    }
+    merge->count++;
+    merge->live++;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Next max accesses (or fewer) of the interleaved streams. Returns 0 at the end
+of every stream.
+------------------------------------------------------------------------------*/
+size_t nextMergedBatch(TraceMerge *merge, TraceAccess *batch, size_t max) {
+
+  size_t n = 0;
+
+  if (merge->count == 1) // nothing to interleave
+    return merge->live ? nextTraceBatch(&merge->streams[0].file, batch, max) : 0;
+
+  while (n < max && merge->live) {
+    TraceStream *stream = &merge->streams[merge->current];
+
+    if (stream->next == stream->length && !stream->done) {
+      stream->length = nextTraceBatch(&stream->file, stream->batch, TRACE_BATCH_SIZE);
+      stream->next = 0;
+      if (!stream->length) {
+        stream->done = 1;
+        merge->live--;
+      }
+    }
+
+    if (stream->done || merge->taken == merge->quantum) { // next core's turn
+      merge->current = (merge->current + 1) % merge->count;
+      merge->taken = 0;
+      continue;
+    }
+
+    batch[n] = stream->batch[stream->next++];
+    batch[n].core = (uint8_t)merge->current;
+    merge->taken++;
+    n++;
+  }
+  return n;
+}
+
+void closeTraceMerge(TraceMerge *merge) {
+  for (uint32_t i = 0; i < merge->count; i++)
+    closeTrace(&merge->streams[i].file);
+  free(merge->streams);
+  merge->streams = NULL;
+}
+
+int writeTraceHeader(FILE *out) {
+
+  TraceHeader header;
+
+  memcpy(header.magic, TRACE_MAGIC, 8);
+  header.version = TRACE_VERSION;
+  header.recordSize = sizeof(TraceRecord);
+  return fwrite(&header, sizeof(header), 1, out) == 1 ? 0 : -1;
+}
+
+int writeTraceRecords(FILE *out, const TraceAccess *batch, size_t count) {
+
+  TraceRecord records[TRACE_BATCH_SIZE];
+
+  while (count > 0) {
+    size_t n = count < TRACE_BATCH_SIZE ? count : TRACE_BATCH_SIZE;
+
+    for (size_t i = 0; i < n; i++) {
+      records[i].address = batch[i].address;
+      records[i].value = batch[i].value;
+      records[i].mode = batch[i].mode;
+      records[i].size = batch[i].size;
+      records[i].core = batch[i].core;
+      records[i].reserved = 0;
+    }
+    if (fwrite(records, sizeof(TraceRecord), n, out) != n)
+      return -1;
+
+    batch += n;
+    count -= n;
+  }
+  return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+Starts a packed trace on out, blockAccesses accesses per block (0: the
+default, PACK_BLOCK_ACCESSES). Returns 0 on success, -1 on error (errno is
+set).
+------------------------------------------------------------------------------*/
+int openPacker(TracePacker *packer, FILE *out, uint32_t blockAccesses) {
+
+  PackHeader header;
+
+  memset(packer, 0, sizeof(*packer));
+  packer->out = out;
+  packer->blockAccesses = blockAccesses ? blockAccesses : PACK_BLOCK_ACCESSES;
+  packer->size = WORD_SIZE;
+  packer->block = malloc((size_t)packer->blockAccesses * PACK_MAX_RECORD);
+  if (!packer->block) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  memcpy(header.magic, PACK_MAGIC, 8);
+  header.version = PACK_VERSION;
+  header.blockAccesses = packer->blockAccesses;
+  packer->offset = sizeof(header);
+  return fwrite(&header, sizeof(header), 1, out) == 1 ? 0 : -1;
+}
+
+/* The bytes value takes, minimum at least. */
+static inline uint32_t byteCount(uint64_t value, uint32_t minimum) {
+  uint32_t bytes = value ? (uint32_t)(71 - __builtin_clzll(value)) / 8 : 0;
+  return bytes > minimum ? bytes : minimum;
+}
+
+/* Writes the block being filled, if it holds anything, and starts another. */
+static int flushBlock(TracePacker *packer) {
+
+  PackBlock block = {packer->accesses, (uint32_t)packer->used,
+                     checksum(packer->block, packer->used), 0};
+
+  if (!packer->accesses)
+    return 0;
+
+  if (packer->blocks == packer->capacity) {
+    uint64_t capacity = packer->capacity ? 2 * packer->capacity : 64;
+    PackIndexEntry *grown = realloc(packer->index, capacity * sizeof(PackIndexEntry));
+    if (!grown) {
+      errno = ENOMEM;
+      return -1;
+    }
+    packer->index = grown;
+    packer->capacity = capacity;
+  }
+  packer->index[packer->blocks].offset = packer->offset;
+  packer->index[packer->blocks].first = packer->total;
+  packer->blocks++;
+
+  if (fwrite(&block, sizeof(block), 1, packer->out) != 1 ||
+      fwrite(packer->block, 1, packer->used, packer->out) != packer->used)
+    return -1;
+
+  packer->offset += sizeof(block) + packer->used;
+  packer->total += packer->accesses;
+  packer->used = 0;
+  packer->accesses = 0;
+  packer->previous = 0;
+  packer->core = 0;
+  packer->size = WORD_SIZE;
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Appends count accesses (or marks) to a packed trace.
+Returns 0 on success, -1 on error (errno is set).
+------------------------------------------------------------------------------*/
+int packAccesses(TracePacker *packer, const TraceAccess *batch, size_t count) {
+
+  for (size_t i = 0; i < count; i++) {
+    const TraceAccess *access = &batch[i];
+    uint8_t *p = packer->block + packer->used;
+    uint64_t field;
+    uint32_t bytes, valueBytes = 0;
+
+    if (access->mode != MODE_MARK && (!access->size || access->size > MAX_ACCESS_SIZE)) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (access->core != packer->core) {
+      *p++ = PACK_CORE << 2 | PACK_SWITCH;
+      *p++ = packer->core = access->core;
+    }
+    if (access->mode == MODE_MARK) {
+      field = access->address;
+      bytes = byteCount(field, 1);
+      *p++ = (uint8_t)((bytes - 1) << 2 | MODE_MARK);
+    }
+    else {
+      int64_t delta = (int64_t)(access->address - packer->previous);
+      uint32_t mode = access->mode == MODE_READ ? MODE_READ : MODE_WRITE;
+
+      if (access->size != packer->size) {
+        *p++ = PACK_SIZE << 2 | PACK_SWITCH;
+        *p++ = packer->size = access->size;
+      }
+      field = (uint64_t)delta << 1 ^ (uint64_t)(delta >> 63);
+      bytes = byteCount(field, 1);
+      valueBytes = mode == MODE_WRITE ? byteCount(access->value, 0) : 0;
+      *p++ = (uint8_t)(valueBytes << 5 | (bytes - 1) << 2 | mode);
+      packer->previous = access->address;
+    }
+    memcpy(p, &field, bytes);
+    memcpy(p + bytes, &access->value, valueBytes);
+    packer->used = (size_t)(p + bytes + valueBytes - packer->block);
+
+    if (++packer->accesses == packer->blockAccesses && flushBlock(packer) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Writes the last block, the index and the trailer; out stays open.
+Returns 0 on success, -1 on error (errno is set).
+------------------------------------------------------------------------------*/
+int closePacker(TracePacker *packer) {
+
+  PackTrailer trailer;
+  int status = flushBlock(packer);
+
+  trailer.indexOffset = packer->offset;
+  trailer.blocks = packer->blocks;
+  trailer.accesses = packer->total;
+  memcpy(trailer.magic, PACK_MAGIC, 8);
+  if (status == 0 && (fwrite(packer->index, sizeof(PackIndexEntry), packer->blocks, packer->out) !=
+                      packer->blocks || fwrite(&trailer, sizeof(trailer), 1, packer->out) != 1))
+    status = -1;
+
+  free(packer->block);
+  free(packer->index);
+  packer->block = NULL;
+  packer->index = NULL;
+  return status;
+}
@@ -0,0 +1,165 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_BATCH_SIZE 4096              // accesses handed to the cache per batch
+#define MAX_ACCESS_SIZE 64                 // widest access, in bytes (AVX-512)
+#define TRACE_WINDOW (64u * 1024 * 1024)   // bytes of the mapping kept resident
+
+#define TRACE_MAGIC "OC1TRACE"
+#define TRACE_VERSION 1
+
+#define PACK_MAGIC "OC1TPACK"
+#define PACK_VERSION 1
+#define PACK_BLOCK_ACCESSES 65536   // default accesses per packed block
+#define PACK_MAX_RECORD 17          // bytes: core and size switches, op, address delta, value
+
+typedef enum TraceFormat {
+  TRACE_TEXT,    /* "Read; Address A; Value V; Time T" or "R[size] A [V]" lines */
+  TRACE_BINARY,  /* TraceHeader followed by fixed size TraceRecords */
+  TRACE_PACKED   /* PackHeader, checksummed blocks of delta coded records, index */
+} TraceFormat;
+
+/* One access as seen by the cache hierarchy. */
+typedef struct TraceAccess {
+  uint64_t address;
+  uint32_t value;
+  uint8_t mode;   /* MODE_READ or MODE_WRITE */
+  uint8_t core;   /* issuing core, 0 in text traces */
+  uint8_t size;   /* bytes, 1 to MAX_ACCESS_SIZE, at any alignment */
+} TraceAccess;
+
+/* On-disk layout of a binary trace (little endian). */
+typedef struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+} TraceHeader;
+
+typedef struct TraceRecord {
+  uint64_t address;
+  uint32_t value;
+  uint8_t mode;
+  uint8_t size;      /* access width in bytes */
+  uint8_t core;      /* 0 in traces written before multicore support */
+  uint8_t reserved;
+} TraceRecord;
+
+/* On-disk layout of a packed trace (little endian): a PackHeader, blocks of
+   at most blockAccesses accesses (marks included), each a PackBlock and its
+   bytes, then one PackIndexEntry per block and a PackTrailer. Records (see
+   Trace.c) are decoded from the start of their block, so one can be read
+   alone. */
+typedef struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t blockAccesses;
+} PackHeader;
+
+typedef struct PackBlock {
+  uint32_t accesses;
+  uint32_t bytes;     /* of records, after this header */
+  uint32_t checksum;  /* CRC-32C of those bytes */
+  uint32_t reserved;
+} PackBlock;
+
+typedef struct PackIndexEntry {
+  uint64_t offset;    /* of the PackBlock in the file */
+  uint64_t first;     /* number of its first access */
+} PackIndexEntry;
+
+typedef struct PackTrailer {
+  uint64_t indexOffset;
+  uint64_t blocks;
+  uint64_t accesses;
+  char magic[8];      /* PACK_MAGIC again */
+} PackTrailer;
+
+/* Streaming reader over a memory mapped trace file. */
+typedef struct TraceFile {
+  int fd;
+  const uint8_t *map;
+  size_t length;
+  size_t cursor;    /* next byte to decode */
+  size_t released;  /* bytes already dropped from the page cache mapping */
+  uint64_t line;    /* current line, for text diagnostics */
+  TraceFormat format;
+  int error;        /* errno of the decoding error that ended the trace, or 0 */
+  size_t blockEnd;  /* packed: end of the block being decoded */
+  uint64_t previous;  /* ... its last address */
+  uint8_t core;       /* ... core */
+  uint8_t size;       /* ... and access size */
+  uint64_t blocks;    /* ... blocks in the index, at indexOffset */
+  size_t indexOffset;
+} TraceFile;
+
+/* One trace of a TraceMerge, with its own decoded batch. */
+typedef struct TraceStream {
+  TraceFile file;
+  TraceAccess batch[TRACE_BATCH_SIZE];
+  size_t length;
+  size_t next;
+  int done;
+} TraceStream;
+
+/* Per core traces interleaved round robin, quantum accesses per turn. */
+typedef struct TraceMerge {
+  TraceStream *streams;
+  uint32_t count;
+  uint32_t live;      /* streams not exhausted yet */
+  uint32_t current;   /* stream whose turn it is */
+  uint32_t taken;     /* accesses it took this turn */
+  uint32_t quantum;
+} TraceMerge;
+
+/* Streaming writer of a packed trace, block by block. */
+typedef struct TracePacker {
+  FILE *out;
+  uint32_t blockAccesses;
+  uint8_t *block;         /* records of the block being filled */
+  size_t used;
+  uint32_t accesses;      /* ... in it */
+  uint64_t previous;      /* ... its last address */
+  uint8_t core;           /* ... core */
+  uint8_t size;           /* ... and access size */
+  uint64_t offset;        /* in the file, of the next block */
+  uint64_t total;         /* accesses in the blocks written */
+  PackIndexEntry *index;
+  uint64_t blocks;
+  uint64_t capacity;
+} TracePacker;
+
+/*********************** Reading *************************/
+
+int openTrace(TraceFile *, const char *);
+
+size_t nextTraceBatch(TraceFile *, TraceAccess *, size_t);
+
+int seekTrace(TraceFile *, uint64_t);
+
+void closeTrace(TraceFile *);
+
+TraceAccess *loadTrace(const char *, size_t *);
+
+int openTraceMerge(TraceMerge *, const char *const *, uint32_t, uint32_t);
+
+size_t nextMergedBatch(TraceMerge *, TraceAccess *, size_t);
+
+void closeTraceMerge(TraceMerge *);
+
+/*********************** Writing *************************/
+
+int writeTraceHeader(FILE *);
+
+int writeTraceRecords(FILE *, const TraceAccess *, size_t);
+
+int openPacker(TracePacker *, FILE *, uint32_t);
+
+int packAccesses(TracePacker *, const TraceAccess *, size_t);
+
+int closePacker(TracePacker *);
+
+#endif
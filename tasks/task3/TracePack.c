@@ -0,0 +1,152 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "Cache.h"
+#include "Trace.h"
+
+/*------------------------------------------------------------------------------
+Converts a trace (text, as the drivers print it, binary or packed) into a
+packed trace (see Trace.c), or back into binary or short form text, without
+simulating it; or only decodes it, to time the decoder.
+
+usage: tracepack [-b|-t] [-B accesses] [-j first] [-n count] in out
+       tracepack -d in
+  -b           write a binary trace (fixed size records) instead
+  -t           write short form text ("R 0x40", "W8 0x48 5", "M 1"); the
+               cores are lost
+  -B accesses  accesses per packed block (default PACK_BLOCK_ACCESSES)
+  -j first     start at access first (through the index of a packed trace)
+  -n count     convert count accesses at most
+  -d           decode in and report the accesses and bytes per second
+------------------------------------------------------------------------------*/
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static int writeText(FILE *out, const TraceAccess *batch, size_t count) {
+
+  for (size_t i = 0; i < count; i++) {
+    const TraceAccess *access = &batch[i];
+    char size[8] = "";
+
+    if (access->mode == MODE_MARK) {
+      fprintf(out, "M %llu\n", (unsigned long long)access->address);
+      continue;
+    }
+    if (access->size != WORD_SIZE)
+      snprintf(size, sizeof(size), "%u", access->size);
+    if (access->mode == MODE_READ)
+      fprintf(out, "R%s 0x%llx\n", size, (unsigned long long)access->address);
+    else
+      fprintf(out, "W%s 0x%llx %u\n", size, (unsigned long long)access->address, access->value);
+  }
+  return ferror(out) ? -1 : 0;
+}
+
+static long long fileSize(const char *path) {
+  struct stat info;
+  return stat(path, &info) == 0 ? (long long)info.st_size : -1;
+}
+
+int main(int argc, char **argv) {
+
+  static TraceAccess batch[TRACE_BATCH_SIZE];
+  const char *in = NULL, *outPath = NULL;
+  TraceFormat format = TRACE_PACKED;
+  TraceFile trace;
+  TracePacker packer;
+  uint32_t blockAccesses = 0;
+  uint64_t first = 0, limit = UINT64_MAX, accesses = 0;
+  int decode = 0, status = 0;
+  size_t count;
+  FILE *out = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-b") == 0)
+      format = TRACE_BINARY;
+    else if (strcmp(argv[i], "-t") == 0)
+      format = TRACE_TEXT;
+    else if (strcmp(argv[i], "-d") == 0)
+      decode = 1;
+    else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc)
+      blockAccesses = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      first = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      limit = strtoull(argv[++i], NULL, 0);
+    else if (!in)
+      in = argv[i];
+    else if (!outPath)
+      outPath = argv[i];
+    else
+      in = NULL; // too many names: usage
+  }
+
+  if (!in || !outPath == !decode) {
+    fprintf(stderr, "usage: %s [-b|-t] [-B accesses] [-j first] [-n count] in out\n"
+            "       %s -d in\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  if (openTrace(&trace, in) < 0 || (first && seekTrace(&trace, first) < 0)) {
+    perror(in);
+    return 1;
+  }
+
+  if (decode) {
+    double start = seconds();
+    while ((count = nextTraceBatch(&trace, batch, TRACE_BATCH_SIZE)) > 0)
+      accesses += count;
+    double elapsed = seconds() - start;
+    long long bytes = fileSize(in);
+
+    printf("%llu accesses, %lld bytes, %.3f s: %.1f M accesses/s, %.2f GB/s\n",
+           (unsigned long long)accesses, bytes, elapsed,
+           elapsed > 0 ? accesses / elapsed / 1e6 : 0.0,
+           elapsed > 0 ? bytes / elapsed / 1e9 : 0.0);
+  }
+  else {
+    out = fopen(outPath, "wb");
+    if (!out || (format == TRACE_PACKED && openPacker(&packer, out, blockAccesses) < 0) ||
+        (format == TRACE_BINARY && writeTraceHeader(out) < 0)) {
+      perror(outPath);
+      return 1;
+    }
+
+    while (accesses < limit &&
+           (count = nextTraceBatch(&trace, batch, limit - accesses < TRACE_BATCH_SIZE ?
+                                   (size_t)(limit - accesses) : TRACE_BATCH_SIZE)) > 0) {
+      int written = format == TRACE_PACKED ? packAccesses(&packer, batch, count) :
+                    format == TRACE_BINARY ? writeTraceRecords(out, batch, count) :
+                    writeText(out, batch, count);
+      if (written < 0) {
+        perror(outPath);
+        return 1;
+      }
+      accesses += count;
+    }
+
+    if (format == TRACE_PACKED && closePacker(&packer) < 0)
+      status = -1;
+    if (fclose(out) != 0 || status < 0) {
+      perror(outPath);
+      return 1;
+    }
+    printf("%llu accesses, %lld bytes -> %lld bytes\n", (unsigned long long)accesses,
+           fileSize(in), fileSize(outPath));
+  }
+
+  if (trace.error) {
+    errno = trace.error;
+    perror(in);
+    return 1;
+  }
+  closeTrace(&trace);
+
+  return 0;
+}
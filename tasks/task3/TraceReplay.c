@@ -0,0 +1,331 @@
+#include <errno.h>
+#include <time.h>
+#include "Checkpoint.h"
+#include "L2Cache2w.h"
+#include "StackDist.h"
+#include "Workload.h"
+
+/*------------------------------------------------------------------------------
+Replays a text or binary trace, or a synthetic workload, through the cache
+hierarchy. With -o warmup=N (or warmup_mark=1 and an "M" line in the trace)
+the first accesses only fast-forward it, and the counters, the time and the
+stats dumps cover the rest.
+
+usage: replay [-f config] [-o key=value]... [-c out.bin|out.pack] [-j first] [-s]
+              [-S stats.json|stats.csv [-i interval]] [-q quantum]
+              [-l events.bin [-L level]] [-r in.ckpt] [-k out.ckpt]
+              trace...|-w workload
+  -f config    read cache geometry and latencies from a config file
+  -o key=value override one config option (see Config.c for the keys)
+  -c out.bin   also write the decoded accesses as a binary trace, packed
+               (delta coded, see Trace.c) if the name ends in .pack
+  -j first     start every trace at its access first, through the index of
+               a packed trace
+  -s           profile LRU stack distances of the L1 miss stream and report
+               L2 hits and misses for 1 to 4x the configured sets and
+               1 to PROFILE_WAYS ways, in the same pass
+  -S file      dump the counters of every level at the end of the run, as
+               CSV if file ends in .csv, JSON otherwise ("-" is stdout)
+  -i interval  also dump them every interval accesses (cumulative; one JSON
+               object per line, or more CSV rows)
+  -q quantum   with several traces, one per core (cores defaults to their
+               number), take quantum accesses from each in turn (default 1);
+               -c then writes the interleaved trace with its cores
+  -l events.bin  log the accesses to a binary event log (see logdecode)
+  -L level     what it records: none, marks, misses (L1 misses) or accesses
+               (default)
+  -w workload  replay a generated workload instead of traces,
+               "kind:key=value,..." (see Workload.c), e.g.
+               "zipf:footprint=256M,skew=120,accesses=100M"; its cores
+               defaults to the config's
+  -r in.ckpt   start from a checkpoint: its state and config, on top of which
+               -f and -o may change latencies only; its counters are
+               cleared, time goes on from its clock
+  -k out.ckpt  save a checkpoint of the hierarchy after the last access, before
+               the write buffers and DRAM queue drain
+------------------------------------------------------------------------------*/
+
+#define PROFILE_WAYS 16
+
+static void profileListener(void *profile, uint64_t address, uint32_t mode) {
+  (void)mode;
+  profileAccess(profile, address);
+}
+
+static void dumpStats(FILE *file, int csv, const Hierarchy *h, uint64_t accesses) {
+  if (h->warm)
+    accesses -= h->warm->accesses;
+  if (csv)
+    writeStatsCsv(file, h, accesses);
+  else
+    writeStatsJson(file, h, accesses);
+}
+
+static double seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+
+  static TraceAccess batch[TRACE_BATCH_SIZE];
+  const char *paths[MAX_CORES], *convert = NULL, *statsPath = NULL, *logPath = NULL;
+  const char *spec = NULL, *restorePath = NULL, *savePath = NULL;
+  WorkloadConfig generator;
+  Workload workload;
+  static EventLog log;
+  FILE *out = NULL, *stats = NULL;
+  CacheConfig config;
+  Hierarchy *h;
+  StackProfile profile;
+  int stackMode = 0, csv = 0, pack = 0;
+  TracePacker packer;
+  TraceMerge trace;
+  uint32_t numPaths = 0, quantum = 1, logLevel = LOG_ACCESSES;
+  uint64_t first = 0;
+  uint64_t accesses = 0, reads = 0, marks = 0, interval = 0, nextDump;
+  size_t count;
+
+  defaultConfig(&config);
+
+  // a checkpoint's config is the base the options apply to
+  for (int i = 1; i + 1 < argc; i++)
+    if (strcmp(argv[i], "-r") == 0)
+      restorePath = argv[i + 1];
+  if (restorePath && readCheckpointConfig(restorePath, &config) < 0)
+    return 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      convert = argv[++i];
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      first = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-s") == 0)
+      stackMode = 1;
+    else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+      statsPath = argv[++i];
+    else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+      interval = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc)
+      quantum = (uint32_t)atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      i++;
+    else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+      savePath = argv[++i];
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+      spec = argv[++i];
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+      logPath = argv[++i];
+    else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+      for (logLevel = 0; LogLevelNames[logLevel]; logLevel++)
+        if (strcmp(LogLevelNames[logLevel], argv[i + 1]) == 0)
+          break;
+      if (!LogLevelNames[logLevel]) {
+        fprintf(stderr, "invalid log level: %s\n", argv[i + 1]);
+        return 1;
+      }
+      i++;
+    }
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      if (loadConfig(&config, argv[++i]) < 0)
+        return 1;
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      if (setConfigOption(&config, argv[++i]) < 0) {
+        fprintf(stderr, "invalid option: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (numPaths < MAX_CORES)
+      paths[numPaths++] = argv[i];
+    else {
+      fprintf(stderr, "at most %d traces\n", MAX_CORES);
+      return 1;
+    }
+  }
+
+  if (!numPaths == !spec) {
+    fprintf(stderr, "usage: %s [-f config] [-o key=value]... [-c out.bin|out.pack] [-j first] [-s] "
+            "[-S stats.json|stats.csv [-i interval]] [-q quantum] "
+            "[-l events.bin [-L level]] [-r in.ckpt] [-k out.ckpt] trace...|-w workload\n", argv[0]);
+    return 1;
+  }
+
+  if (numPaths > 1 && config.cores == 1)
+    config.cores = numPaths;
+  if (numPaths > config.cores) {
+    fprintf(stderr, "%u traces for %u cores\n", numPaths, config.cores);
+    return 1;
+  }
+
+  if (checkConfig(&config) < 0)
+    return 1;
+  h = createHierarchy(&config);
+  if (!h) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  if (restorePath) {
+    if (restoreCheckpoint(h, restorePath) < 0)
+      return 1;
+    clearStats(h);
+  }
+
+  if (stackMode) {
+    uint32_t sets = config.level[1].size / config.blockSize / config.level[1].ways;
+    if (initStackProfile(&profile, config.blockSize, 4 * sets, PROFILE_WAYS) < 0) {
+      fprintf(stderr, "cannot profile %u sets of %u byte blocks\n", 4 * sets, config.blockSize);
+      return 1;
+    }
+    setL2Listener(h, profileListener, &profile);
+  }
+
+  if (spec) {
+    defaultWorkload(&generator);
+    generator.cores = config.cores;
+    if (parseWorkload(&generator, spec) < 0) {
+      fprintf(stderr, "invalid workload: %s\n", spec);
+      return 1;
+    }
+    if (openWorkload(&workload, &generator) < 0)
+      return 1;
+  }
+  else if (openTraceMerge(&trace, paths, numPaths, quantum) < 0) {
+    perror(paths[trace.count]);
+    return 1;
+  }
+  for (uint32_t i = 0; !spec && first && i < numPaths; i++)
+    if (seekTrace(&trace.streams[i].file, first) < 0) {
+      perror(paths[i]);
+      return 1;
+    }
+
+  if (convert) {
+    size_t length = strlen(convert);
+    pack = length >= 5 && strcmp(convert + length - 5, ".pack") == 0;
+    out = fopen(convert, "wb");
+    if (!out || (pack ? openPacker(&packer, out, 0) : writeTraceHeader(out)) < 0) {
+      perror(convert);
+      return 1;
+    }
+  }
+
+  if (logPath) {
+    if (openEventLog(&log, logPath, logLevel) < 0) {
+      perror(logPath);
+      return 1;
+    }
+    setEventLog(h, &log);
+  }
+
+  if (statsPath) {
+    size_t length = strlen(statsPath);
+    csv = length >= 4 && strcmp(statsPath + length - 4, ".csv") == 0;
+    stats = strcmp(statsPath, "-") == 0 ? stdout : fopen(statsPath, "w");
+    if (!stats) {
+      perror(statsPath);
+      return 1;
+    }
+    if (csv)
+      writeStatsCsvHeader(stats);
+  }
+  nextDump = stats && interval ? interval : UINT64_MAX;
+
+  double start = seconds();
+
+  while ((count = spec ? nextWorkloadBatch(&workload, batch, TRACE_BATCH_SIZE)
+                       : nextMergedBatch(&trace, batch, TRACE_BATCH_SIZE)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      if (batch[i].core >= config.cores) {
+        fprintf(stderr, "access %llu is from core %u, set cores\n",
+                (unsigned long long)(accesses + i), batch[i].core);
+        return 1;
+      }
+      reads += batch[i].mode == MODE_READ;
+    }
+
+    // split the batch so interval dumps land on exact multiples; like the
+    // last one, they count accesses without the marks
+    for (size_t done = 0; done < count;) {
+      size_t part = count - done;
+      if (nextDump - accesses - done < part)
+        part = (size_t)(nextDump - accesses - done);
+      size_t replayed = accessBatch(h, &batch[done], part);
+      if (replayed < part) {
+        fprintf(stderr, "access %llu is out of range (size %u, address 0x%llx)\n",
+                (unsigned long long)(accesses + done + replayed), batch[done + replayed].size,
+                (unsigned long long)batch[done + replayed].address);
+        return 1;
+      }
+      for (size_t i = done; i < done + part; i++)
+        marks += batch[i].mode == MODE_MARK;
+      done += part;
+      if (accesses + done == nextDump) {
+        dumpStats(stats, csv, h, nextDump - marks);
+        nextDump += interval;
+      }
+    }
+
+    accesses += count;
+
+    if (out && (pack ? packAccesses(&packer, batch, count)
+                     : writeTraceRecords(out, batch, count)) < 0) {
+      perror(convert);
+      return 1;
+    }
+  }
+  for (uint32_t i = 0; !spec && i < numPaths; i++)
+    if (trace.streams[i].file.error) {
+      errno = trace.streams[i].file.error;
+      perror(paths[i]);
+      return 1;
+    }
+
+  // a run shorter than its warmup ends it here
+  endWarmup(h);
+  // before the end of run drain, so a run restored from it goes on exactly
+  if (savePath && saveCheckpoint(h, savePath) < 0)
+    return 1;
+  flushWriteBuffers(h);
+  double elapsed = seconds() - start;
+
+  if (spec)
+    closeWorkload(&workload);
+  else
+    closeTraceMerge(&trace);
+  if (out) {
+    int failed = pack && closePacker(&packer) < 0;
+    if (fclose(out) != 0 || failed) {
+      perror(convert);
+      return 1;
+    }
+  }
+  if (logPath && closeEventLog(&log) < 0) {
+    perror(logPath);
+    return 1;
+  }
+
+  printf("Accesses %llu; Reads %llu; Writes %llu; Time %llu\n",
+         (unsigned long long)(accesses - marks), (unsigned long long)reads,
+         (unsigned long long)(accesses - marks - reads), (unsigned long long)h->time);
+  if (h->warm)
+    printf("Fast-forwarded %llu accesses\n", (unsigned long long)h->warm->accesses);
+  printf("Host time %.3f s; %.1f M accesses/s\n", elapsed,
+         elapsed > 0 ? accesses / elapsed / 1e6 : 0.0);
+
+  if (stackMode) {
+    printStackProfile(stdout, &profile);
+    freeStackProfile(&profile);
+  }
+  if (stats) {
+    if (!interval || accesses % interval)
+      dumpStats(stats, csv, h, accesses - marks);
+    if (stats != stdout)
+      fclose(stats);
+  }
+  destroyHierarchy(h);
+
+  return 0;
+}
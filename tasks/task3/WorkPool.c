@@ -0,0 +1,152 @@
+/*******************************************************************************
+*                                                                              *
+*                      Work-stealing thread pool                               *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Runs a fixed set of independent work items on a pool of threads.
+
+Items are dealt round-robin to one deque per worker. A worker pops from the
+tail of its own deque and, once it is empty, steals from the head of the
+others, so long running items (big caches, slow configurations) do not leave
+the remaining workers idle. No item creates new work, so a worker that finds
+every deque empty is done.
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "WorkPool.h"
+
+typedef struct Worker {
+  WorkPool *pool;
+  uint32_t id;
+} Worker;
+
+uint32_t defaultWorkers() {
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  return online > 0 ? (uint32_t)online : 1;
+}
+
+static int popOwn(WorkQueue *queue, WorkItem *item) {
+
+  int found = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail > queue->head) {
+    *item = queue->items[--queue->tail];
+    found = 1;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static int steal(WorkQueue *queue, WorkItem *item) {
+
+  int found = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail > queue->head) {
+    *item = queue->items[queue->head++];
+    found = 1;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+/*------------------------------------------------------------------------------
+Finds the next item for worker id: own deque first, then the other workers'
+deques starting with the next one.
+------------------------------------------------------------------------------*/
+static int nextItem(WorkPool *pool, uint32_t id, WorkItem *item) {
+
+  if (popOwn(&pool->queues[id], item))
+    return 1;
+
+  for (uint32_t i = 1; i < pool->workers; i++) {
+    if (steal(&pool->queues[(id + i) % pool->workers], item)) {
+      __atomic_fetch_add(&pool->steals, 1, __ATOMIC_RELAXED);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *workerMain(void *argument) {
+
+  Worker *worker = argument;
+  WorkItem item;
+
+  while (nextItem(worker->pool, worker->id, &item))
+    item.function(item.argument);
+
+  return NULL;
+}
+
+/*------------------------------------------------------------------------------
+Runs all items on the given number of worker threads and waits for them.
+steals, if not NULL, receives how many items were taken from another deque.
+If no thread can be created the items run on the calling thread. Returns how
+many threads ran them: workers, but no more than count, nor than were created.
+------------------------------------------------------------------------------*/
+uint32_t runWork(const WorkItem *items, size_t count, uint32_t workers, uint64_t *steals) {
+
+  WorkPool pool;
+  pthread_t *threads;
+  Worker *args;
+  uint32_t started = 0;
+
+  if (workers == 0)
+    workers = 1;
+  if (workers > count)
+    workers = count ? (uint32_t)count : 1;
+
+  pool.workers = workers;
+  pool.steals = 0;
+  pool.queues = calloc(workers, sizeof(WorkQueue));
+  threads = calloc(workers, sizeof(pthread_t));
+  args = calloc(workers, sizeof(Worker));
+  if (!pool.queues || !threads || !args)
+    exit(-1);
+
+  for (uint32_t w = 0; w < workers; w++) {
+    pthread_mutex_init(&pool.queues[w].lock, NULL);
+    pool.queues[w].items = malloc((count / workers + 1) * sizeof(WorkItem));
+    if (!pool.queues[w].items)
+      exit(-1);
+  }
+
+  // deal the items round-robin
+  for (size_t i = 0; i < count; i++) {
+    WorkQueue *queue = &pool.queues[i % workers];
+    queue->items[queue->tail++] = items[i];
+  }
+
+  for (uint32_t w = 0; w < workers; w++) {
+    args[w].pool = &pool;
+    args[w].id = w;
+    if (pthread_create(&threads[w], NULL, workerMain, &args[w]) != 0)
+      break;
+    started++;
+  }
+
+  // with no threads at all, run everything here
+  if (started == 0)
+    workerMain(&args[0]);
+
+  for (uint32_t w = 0; w < started; w++)
+    pthread_join(threads[w], NULL);
+
+  for (uint32_t w = 0; w < workers; w++) {
+    pthread_mutex_destroy(&pool.queues[w].lock);
+    free(pool.queues[w].items);
+  }
+
+  if (steals)
+    *steals = pool.steals;
+
+  free(pool.queues);
+  free(threads);
+  free(args);
+  return started ? started : 1;
+}
@@ -0,0 +1,33 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*WorkFunction)(void *);
+
+typedef struct WorkItem {
+  WorkFunction function;
+  void *argument;
+} WorkItem;
+
+/* Per worker deque: the owner pops at the tail, thieves take from the head. */
+typedef struct WorkQueue {
+  pthread_mutex_t lock;
+  WorkItem *items;
+  size_t head;
+  size_t tail;
+} WorkQueue;
+
+typedef struct WorkPool {
+  uint32_t workers;
+  WorkQueue *queues;
+  uint64_t steals;
+} WorkPool;
+
+uint32_t defaultWorkers();
+
+uint32_t runWork(const WorkItem *, size_t, uint32_t, uint64_t *);
+
+#endif
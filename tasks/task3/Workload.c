@@ -0,0 +1,604 @@
+/*******************************************************************************
+*                                                                              *
+*                      Synthetic workloads                                     *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Generates access streams in TraceAccess batches, ready for accessBatch, so
+synthetic workloads need no trace file. A workload is a kind plus
+"key=value" options, written "kind:key=value,key=value" (Keys below, the
+defaults in defaultWorkload):
+
+  sequential  size bytes after size bytes over footprint bytes, wrapping
+  strided     stride bytes apart, each pass shifted by size from the last
+  random      uniform, size aligned, over the footprint
+  zipf        a block of blockSize bytes by Zipf rank (exponent skew/100,
+              rank 1 the first block) and a random aligned word in it: a hot
+              set and a long tail
+  chase       reads of the first word of each block along one random cycle
+              through all the blocks of the footprint (a linked list): the
+              blocks in the order of a keyed permutation of their numbers
+  stencil     5 point Jacobi sweeps over two n x n grids of size byte
+              elements: five reads of one grid, a write of the other
+  gemm        C += A * B on n x n matrices in tile x tile tiles: read an
+              element of C, a row of the A tile and a column of the B tile,
+              write the element
+
+The first four write writes percent of their accesses; chase, stencil and
+gemm have their own mix. Accesses go to cores 0 to cores - 1 in turn.
+
+Random numbers come from xoshiro256** seeded through splitmix64, not from
+rand(), so a seed gives the same stream on every host. Zipf ranks take
+constant time whatever the footprint: the ZIPF_HEAD most frequent from an
+alias table (two lookups), the rest, past the table, by rejection-inversion
+(Hormann and Derflinger), which needs no table but a few exp/log calls. The chase permutation is a
+4 round Feistel network over the next power of two of the block numbers
+(cycle walking past the last), not a shuffled successor table: no memory, and no dependent loads
+from a table larger than the host's caches. Every generator is a loop over
+the batch that keeps its position in the Workload between batches.
+------------------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Cache.h"
+#include "Workload.h"
+
+const char *const WorkloadNames[] = {"sequential", "strided", "random", "zipf", "chase",
+                                     "stencil", "gemm", NULL};
+
+typedef struct WorkloadKey {
+  const char *name;
+  size_t field;
+} WorkloadKey;
+
+static const WorkloadKey Keys[] = {
+  {"accesses", offsetof(WorkloadConfig, accesses)},
+  {"base", offsetof(WorkloadConfig, base)},
+  {"footprint", offsetof(WorkloadConfig, footprint)},
+  {"stride", offsetof(WorkloadConfig, stride)},
+  {"block_size", offsetof(WorkloadConfig, blockSize)},
+  {"writes", offsetof(WorkloadConfig, writes)},
+  {"size", offsetof(WorkloadConfig, size)},
+  {"skew", offsetof(WorkloadConfig, skew)},
+  {"n", offsetof(WorkloadConfig, n)},
+  {"tile", offsetof(WorkloadConfig, tile)},
+  {"cores", offsetof(WorkloadConfig, cores)},
+  {"seed", offsetof(WorkloadConfig, seed)},
+};
+
+#define NUM_KEYS (sizeof(Keys) / sizeof(Keys[0]))
+
+
+
+/*******************************************************************************
+Configuration
+*******************************************************************************/
+
+void defaultWorkload(WorkloadConfig *config) {
+  config->kind = WORKLOAD_SEQUENTIAL;
+  config->accesses = 1u << 20;
+  config->base = 0;
+  config->footprint = 64u << 20;
+  config->stride = 65 * 64;
+  config->blockSize = 64;
+  config->writes = 25;
+  config->size = 4;
+  config->skew = 99;
+  config->n = 256;
+  config->tile = 32;
+  config->cores = 1;
+  config->seed = 1;
+}
+
+/* A count with an optional K/M/G suffix, up to 64 bits. */
+static int parseCount(const char *text, size_t length, uint64_t *out) {
+
+  char buffer[32], *end;
+  unsigned long long value;
+
+  if (length == 0 || length >= sizeof(buffer))
+    return -1;
+  memcpy(buffer, text, length);
+  buffer[length] = '\0';
+
+  errno = 0;
+  value = strtoull(buffer, &end, 0);
+  if (end == buffer || errno)
+    return -1;
+
+  switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+  }
+  if (*end != '\0')
+    return -1;
+
+  *out = value;
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Applies one "key=value" option, the kind included ("kind=zipf").
+Returns 0 on success, -1 if the key or value is not valid.
+------------------------------------------------------------------------------*/
+int setWorkloadOption(WorkloadConfig *config, const char *option) {
+
+  const char *equals = strchr(option, '=');
+  size_t length, valueLength;
+
+  if (!equals)
+    return -1;
+  length = (size_t)(equals - option);
+  valueLength = strcspn(equals + 1, ",");
+
+  if (length == 4 && strncmp(option, "kind", 4) == 0) {
+    for (uint32_t i = 0; WorkloadNames[i]; i++)
+      if (strlen(WorkloadNames[i]) == valueLength &&
+          strncmp(WorkloadNames[i], equals + 1, valueLength) == 0) {
+        config->kind = i;
+        return 0;
+      }
+    return -1;
+  }
+
+  for (size_t i = 0; i < NUM_KEYS; i++)
+    if (strlen(Keys[i].name) == length && strncmp(Keys[i].name, option, length) == 0)
+      return parseCount(equals + 1, valueLength, (uint64_t *)((char *)config + Keys[i].field));
+  return -1;
+}
+
+/*------------------------------------------------------------------------------
+Applies "kind[:key=value,key=value...]" on top of config.
+Returns 0 on success, -1 if a part is not valid.
+------------------------------------------------------------------------------*/
+int parseWorkload(WorkloadConfig *config, const char *spec) {
+
+  size_t length = strcspn(spec, ":");
+  char kind[64];
+
+  if (length >= sizeof(kind) - 5)
+    return -1;
+  snprintf(kind, sizeof(kind), "kind=%.*s", (int)length, spec);
+  if (setWorkloadOption(config, kind) < 0)
+    return -1;
+
+  for (const char *p = spec + length; *p;) {
+    p++;
+    if (setWorkloadOption(config, p) < 0)
+      return -1;
+    p += strcspn(p, ",");
+  }
+  return 0;
+}
+
+/* Reports the first invalid parameter. Returns 0 if there is none. */
+static int checkWorkload(const WorkloadConfig *config) {
+
+  const char *error = NULL;
+  uint32_t kind = config->kind;
+
+  if (config->size < 1 || config->size > MAX_ACCESS_SIZE)
+    error = "size must be 1 to MAX_ACCESS_SIZE bytes";
+  else if (config->writes > 100)
+    error = "writes is a percentage";
+  else if (config->cores < 1 || config->cores > UINT8_MAX + 1)
+    error = "cores must be 1 to 256";
+  else if (kind <= WORKLOAD_CHASE && config->footprint < config->size)
+    error = "footprint smaller than an access";
+  else if (kind == WORKLOAD_STRIDED && !config->stride)
+    error = "stride must not be 0";
+  else if ((kind == WORKLOAD_ZIPF || kind == WORKLOAD_CHASE) &&
+           (config->blockSize < config->size || config->footprint < config->blockSize))
+    error = "block_size must fit an access and the footprint a block";
+  else if (kind == WORKLOAD_ZIPF && !config->skew)
+    error = "skew must not be 0";
+  else if (kind == WORKLOAD_STENCIL && config->n < 3)
+    error = "stencil needs n >= 3";
+  else if (kind == WORKLOAD_GEMM && (!config->tile || !config->n || config->n % config->tile))
+    error = "gemm needs a tile that divides n";
+
+  if (error) {
+    fprintf(stderr, "workload %s: %s\n", WorkloadNames[kind], error);
+    return -1;
+  }
+  return 0;
+}
+
+
+
+/*******************************************************************************
+Random numbers
+*******************************************************************************/
+
+/* splitmix64 spreads the seed over the whole state (never all zero). */
+void seedRandom(Random *r, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    r->s[i] = z ^ (z >> 31);
+  }
+}
+
+/* Uniform in [0, bound), without a division. */
+static inline uint64_t randomBelow(Random *r, uint64_t bound) {
+  return (uint64_t)(((unsigned __int128)nextRandom64(r) * bound) >> 64);
+}
+
+static inline double randomUnit(Random *r) {
+  return (double)(nextRandom64(r) >> 11) * 0x1.0p-53;
+}
+
+static inline uint32_t randomMode(Random *r, uint64_t writeLimit) {
+  return (nextRandom64(r) >> 32) < writeLimit ? MODE_WRITE : MODE_READ;
+}
+
+
+
+/*******************************************************************************
+Zipf ranks by rejection-inversion
+*******************************************************************************/
+
+/* log1p(x) / x and expm1(x) / x, accurate near 0. */
+static double helper1(double x) {
+  return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double helper2(double x) {
+  return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+static inline double zipfH(double s, double x) {
+  return exp(-s * log(x));
+}
+
+/* Integral of zipfH, and its inverse. */
+static inline double zipfIntegral(double s, double x) {
+  double logX = log(x);
+  return helper2((1 - s) * logX) * logX;
+}
+
+static inline double zipfInverse(double s, double x) {
+  double t = x * (1 - s);
+  if (t < -1)
+    t = -1;
+  return exp(helper1(t) * x);
+}
+
+/*------------------------------------------------------------------------------
+Builds the alias table of the head ranks (Vose) and the constants of the
+tail's rejection-inversion, and splits the draws between them by mass: the
+tail's from the integral of its weights (the error is far below 1e-6).
+Returns -1 out of memory.
+------------------------------------------------------------------------------*/
+static int initZipf(Workload *w) {
+
+  double s = w->config.skew / 100.0, headMass = 0, tailMass;
+  uint32_t ranks = w->blocks < ZIPF_HEAD ? (uint32_t)w->blocks : ZIPF_HEAD;
+  double *p = malloc(ranks * sizeof(double));
+  uint32_t *small = malloc(ranks * sizeof(uint32_t)), *large = malloc(ranks * sizeof(uint32_t));
+  uint32_t numSmall = 0, numLarge = 0;
+
+  w->head = malloc(ranks * sizeof(AliasEntry));
+  if (!p || !small || !large || !w->head) {
+    free(p);
+    free(small);
+    free(large);
+    return -1;
+  }
+  w->headRanks = ranks;
+
+  for (uint32_t i = 0; i < ranks; i++)
+    headMass += p[i] = zipfH(s, i + 1.0);
+  for (uint32_t i = 0; i < ranks; i++) {
+    p[i] *= ranks / headMass;
+    if (p[i] < 1)
+      small[numSmall++] = i;
+    else
+      large[numLarge++] = i;
+  }
+  while (numSmall && numLarge) {
+    uint32_t less = small[--numSmall], more = large[numLarge - 1];
+    w->head[less].limit = (uint32_t)(p[less] * 4294967296.0);
+    w->head[less].alias = more;
+    p[more] -= 1 - p[less];
+    if (p[more] < 1) {
+      numLarge--;
+      small[numSmall++] = more;
+    }
+  }
+  // what is left is 1 up to rounding
+  while (numLarge) {
+    uint32_t i = large[--numLarge];
+    w->head[i] = (AliasEntry){UINT32_MAX, i};
+  }
+  while (numSmall) {
+    uint32_t i = small[--numSmall];
+    w->head[i] = (AliasEntry){UINT32_MAX, i};
+  }
+  free(p);
+  free(small);
+  free(large);
+
+  // the tail draws u only where its ranks are accepted
+  w->zipfX1 = zipfIntegral(s, ranks + 0.5);
+  w->zipfN = zipfIntegral(s, w->blocks + 0.5);
+  w->zipfS = 2 - zipfInverse(s, zipfIntegral(s, 2.5) - zipfH(s, 2));
+  tailMass = w->zipfN - w->zipfX1;
+  w->tailLimit = w->blocks > ranks ? (uint64_t)(tailMass / (headMass + tailMass) * 18446744073709551616.0) : 0;
+  return 0;
+}
+
+/* A rank from 1 (the most frequent) to blocks. */
+static inline uint64_t zipfRank(const Workload *w, Random *random) {
+
+  double s = w->config.skew / 100.0;
+
+  if (nextRandom64(random) >= w->tailLimit) {
+    uint64_t r = nextRandom64(random);
+    uint32_t slot = (uint32_t)(((r >> 32) * w->headRanks) >> 32);
+    return 1 + ((uint32_t)r < w->head[slot].limit ? slot : w->head[slot].alias);
+  }
+
+  for (;;) {
+    double u = w->zipfN + randomUnit(random) * (w->zipfX1 - w->zipfN);
+    double x = zipfInverse(s, u);
+    uint64_t k = (uint64_t)(x + 0.5);
+    if (k <= w->headRanks)
+      k = w->headRanks + 1;
+    if (k > w->blocks)
+      k = w->blocks;
+    if (k - x <= w->zipfS || u >= zipfIntegral(s, k + 0.5) - zipfH(s, (double)k))
+      return k;
+  }
+}
+
+
+
+/*******************************************************************************
+Generators
+*******************************************************************************/
+
+static inline void setAccess(TraceAccess *access, uint64_t address, uint32_t mode, uint64_t size) {
+  access->address = address;
+  access->value = (uint32_t)address;
+  access->mode = (uint8_t)mode;
+  access->core = 0;
+  access->size = (uint8_t)size;
+}
+
+/* The generators work on a copy of the random state: the stores to the batch
+   could alias w->random and keep it out of registers. */
+
+static void sequential(Workload *w, TraceAccess *batch, size_t count) {
+  const WorkloadConfig *c = &w->config;
+  Random random = w->random;
+  for (size_t i = 0; i < count; i++) {
+    setAccess(&batch[i], c->base + w->cursor, randomMode(&random, w->writeLimit), c->size);
+    w->cursor += c->size;
+    if (w->cursor + c->size > c->footprint)
+      w->cursor = 0;
+  }
+  w->random = random;
+}
+
+static void strided(Workload *w, TraceAccess *batch, size_t count) {
+  const WorkloadConfig *c = &w->config;
+  Random random = w->random;
+  for (size_t i = 0; i < count; i++) {
+    setAccess(&batch[i], c->base + w->cursor, randomMode(&random, w->writeLimit), c->size);
+    w->cursor += c->stride;
+    if (w->cursor + c->size > c->footprint) {
+      w->shift += c->size;
+      if (w->shift >= c->stride || w->shift + c->size > c->footprint)
+        w->shift = 0;
+      w->cursor = w->shift;
+    }
+  }
+  w->random = random;
+}
+
+static void uniform(Workload *w, TraceAccess *batch, size_t count) {
+  const WorkloadConfig *c = &w->config;
+  uint64_t slots = c->footprint / c->size;
+  Random random = w->random;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t address = c->base + randomBelow(&random, slots) * c->size;
+    setAccess(&batch[i], address, randomMode(&random, w->writeLimit), c->size);
+  }
+  w->random = random;
+}
+
+static void zipf(Workload *w, TraceAccess *batch, size_t count) {
+  const WorkloadConfig *c = &w->config;
+  uint64_t slots = c->blockSize / c->size;
+  Random random = w->random;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t block = zipfRank(w, &random) - 1;
+    uint64_t offset = randomBelow(&random, slots) * c->size;
+    setAccess(&batch[i], c->base + block * c->blockSize + offset,
+              randomMode(&random, w->writeLimit), c->size);
+  }
+  w->random = random;
+}
+
+/* Block number i of the chase, a bijection of 0 to blocks - 1. The halves
+   differ by a bit when bits is odd, and swap sizes every round. */
+static inline uint64_t chaseBlock(const Workload *w, uint64_t i) {
+
+  do {
+    uint32_t leftBits = (w->bits + 1) / 2, rightBits = w->bits / 2;
+    uint64_t left = i >> rightBits, right = i & (((uint64_t)1 << rightBits) - 1);
+    for (int round = 0; round < 4; round++) {
+      uint64_t f = (right ^ w->keys[round]) * 0xFF51AFD7ED558CCDULL;
+      uint64_t next = left ^ ((f ^ (f >> 29)) & (((uint64_t)1 << leftBits) - 1));
+      uint32_t swap = leftBits;
+      left = right;
+      right = next;
+      leftBits = rightBits;
+      rightBits = swap;
+    }
+    i = (left << rightBits) | right;
+  } while (i >= w->blocks);
+  return i;
+}
+
+static void chase(Workload *w, TraceAccess *batch, size_t count) {
+  const WorkloadConfig *c = &w->config;
+  for (size_t i = 0; i < count; i++) {
+    setAccess(&batch[i], c->base + chaseBlock(w, w->cursor) * c->blockSize, MODE_READ, c->size);
+    if (++w->cursor == w->blocks)
+      w->cursor = 0;
+  }
+}
+
+/* index: row, column, sweep. */
+static void stencil(Workload *w, TraceAccess *batch, size_t count) {
+
+  const WorkloadConfig *c = &w->config;
+  const uint64_t n = c->n, grid = n * n * c->size;
+  // the 5 points read, as row and column offsets
+  static const int dRow[5] = {-1, 0, 0, 0, 1}, dColumn[5] = {0, -1, 0, 1, 0};
+  uint64_t *index = w->index;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t from = c->base + (index[2] & 1) * grid, to = c->base + (~index[2] & 1) * grid;
+
+    if (w->step < 5) {
+      uint64_t row = index[0] + dRow[w->step], column = index[1] + dColumn[w->step];
+      setAccess(&batch[i], from + (row * n + column) * c->size, MODE_READ, c->size);
+      w->step++;
+      continue;
+    }
+
+    setAccess(&batch[i], to + (index[0] * n + index[1]) * c->size, MODE_WRITE, c->size);
+    w->step = 0;
+    if (++index[1] == n - 1) {
+      index[1] = 1;
+      if (++index[0] == n - 1) {
+        index[0] = 1;
+        index[2]++;
+      }
+    }
+  }
+}
+
+/* index: ii, jj, kk (tile corners), row, column. step 0 reads C[row][column],
+   1 to 2 * tile alternate A[row][k] and B[k][column], the last writes C. */
+static void gemm(Workload *w, TraceAccess *batch, size_t count) {
+
+  const WorkloadConfig *c = &w->config;
+  const uint64_t n = c->n, tile = c->tile, matrix = n * n * c->size;
+  const uint64_t a = c->base, b = a + matrix, cm = b + matrix;
+  uint64_t *index = w->index;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t element = cm + (index[3] * n + index[4]) * c->size;
+
+    if (w->step == 0)
+      setAccess(&batch[i], element, MODE_READ, c->size);
+    else if (w->step <= 2 * tile) {
+      uint64_t k = index[2] + (w->step - 1) / 2;
+      uint64_t address = w->step & 1 ? a + (index[3] * n + k) * c->size
+                                     : b + (k * n + index[4]) * c->size;
+      setAccess(&batch[i], address, MODE_READ, c->size);
+    }
+    else
+      setAccess(&batch[i], element, MODE_WRITE, c->size);
+
+    if (++w->step <= 2 * tile + 1)
+      continue;
+    w->step = 0;
+    if (++index[4] < index[1] + tile)
+      continue;
+    index[4] = index[1];
+    if (++index[3] < index[0] + tile)
+      continue;
+    // next tile: kk fastest, then jj, then ii
+    if ((index[2] += tile) == n) {
+      index[2] = 0;
+      if ((index[1] += tile) == n) {
+        index[1] = 0;
+        if ((index[0] += tile) == n)
+          index[0] = 0;
+      }
+    }
+    index[3] = index[0];
+    index[4] = index[1];
+  }
+}
+
+
+
+/*******************************************************************************
+Interface
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+Starts a stream from config. Returns 0 on success, -1 if config is not
+valid (reported on stderr) or out of memory.
+------------------------------------------------------------------------------*/
+int openWorkload(Workload *w, const WorkloadConfig *config) {
+
+  memset(w, 0, sizeof(*w));
+  if (checkWorkload(config) < 0)
+    return -1;
+  w->config = *config;
+  seedRandom(&w->random, config->seed);
+  w->writeLimit = (config->writes << 32) / 100;
+  w->blocks = config->blockSize ? config->footprint / config->blockSize : 0;
+
+  switch (config->kind) {
+    case WORKLOAD_ZIPF:
+      if (initZipf(w) < 0)
+        return -1;
+      break;
+    case WORKLOAD_CHASE:
+      while (((uint64_t)1 << w->bits) < w->blocks)
+        w->bits++;
+      for (int round = 0; round < 4; round++)
+        w->keys[round] = nextRandom64(&w->random);
+      break;
+    case WORKLOAD_STENCIL:
+      w->index[0] = w->index[1] = 1;
+      break;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Fills batch with up to count next accesses. Returns how many, 0 once the
+workload's accesses are all out.
+------------------------------------------------------------------------------*/
+size_t nextWorkloadBatch(Workload *w, TraceAccess *batch, size_t count) {
+
+  if (count > w->config.accesses - w->issued)
+    count = (size_t)(w->config.accesses - w->issued);
+
+  switch (w->config.kind) {
+    case WORKLOAD_SEQUENTIAL: sequential(w, batch, count); break;
+    case WORKLOAD_STRIDED: strided(w, batch, count); break;
+    case WORKLOAD_RANDOM: uniform(w, batch, count); break;
+    case WORKLOAD_ZIPF: zipf(w, batch, count); break;
+    case WORKLOAD_CHASE: chase(w, batch, count); break;
+    case WORKLOAD_STENCIL: stencil(w, batch, count); break;
+    case WORKLOAD_GEMM: gemm(w, batch, count); break;
+  }
+
+  if (w->config.cores > 1)
+    for (size_t i = 0; i < count; i++)
+      batch[i].core = (uint8_t)((w->issued + i) % w->config.cores);
+
+  w->issued += count;
+  return count;
+}
+
+void closeWorkload(Workload *w) {
+  free(w->head);
+  w->head = NULL;
+}
@@ -0,0 +1,98 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Trace.h"
+
+typedef enum WorkloadKind {
+  WORKLOAD_SEQUENTIAL,  /* size after size over the footprint */
+  WORKLOAD_STRIDED,     /* stride bytes apart, shifted by size on every wrap */
+  WORKLOAD_RANDOM,      /* uniform over the footprint */
+  WORKLOAD_ZIPF,        /* blocks by Zipf rank (skew): a hot set and a long tail */
+  WORKLOAD_CHASE,       /* reads along one random cycle through the blocks */
+  WORKLOAD_STENCIL,     /* 5 point Jacobi sweeps over two n x n grids */
+  WORKLOAD_GEMM         /* C += A * B, n x n, in tile x tile tiles */
+} WorkloadKind;
+
+extern const char *const WorkloadNames[];
+
+#define ZIPF_HEAD (1u << 16)   // top ranks drawn from an alias table
+
+/* A generator's parameters, set by "key=value" options (Workload.c). */
+typedef struct WorkloadConfig {
+  uint32_t kind;        /* WorkloadKind */
+  uint64_t accesses;    /* stream length */
+  uint64_t base;        /* lowest address */
+  uint64_t footprint;   /* bytes covered (sequential to chase) */
+  uint64_t stride;      /* strided */
+  uint64_t blockSize;   /* zipf and chase pick blocks of this size */
+  uint64_t writes;      /* percent of writes (sequential to zipf) */
+  uint64_t size;        /* bytes per access */
+  uint64_t skew;        /* zipf exponent, in hundredths */
+  uint64_t n;           /* stencil and gemm: matrix order */
+  uint64_t tile;        /* gemm */
+  uint64_t cores;       /* accesses go to the cores in turn */
+  uint64_t seed;
+} WorkloadConfig;
+
+/* xoshiro256**: fast, and the same sequence on every host. */
+typedef struct Random {
+  uint64_t s[4];
+} Random;
+
+/* Walker alias table entry: slot i is i below limit, else alias. */
+typedef struct AliasEntry {
+  uint32_t limit;
+  uint32_t alias;
+} AliasEntry;
+
+typedef struct Workload {
+  WorkloadConfig config;
+  Random random;
+  uint64_t issued;
+  uint64_t cursor;      /* sequential, strided: next offset; chase: position */
+  uint64_t shift;       /* strided: offset of the current pass */
+  uint64_t keys[4];     /* chase: Feistel round keys */
+  uint32_t bits;        /* ... over 2^bits numbers, the first blocks of them */
+  uint64_t blocks;      /* zipf, chase: blocks in the footprint */
+  uint64_t writeLimit;  /* a write when 32 random bits are below it */
+  AliasEntry *head;     /* zipf: the first ZIPF_HEAD ranks (or all) */
+  uint32_t headRanks;
+  uint64_t tailLimit;   /* ... the rest when 64 random bits are below it */
+  double zipfX1, zipfN, zipfS;  /* rejection-inversion constants, for the rest */
+  uint64_t index[5];    /* stencil, gemm: loop counters */
+  uint32_t step;        /* ... and access within the innermost body */
+} Workload;
+
+void seedRandom(Random *, uint64_t);
+
+static inline uint64_t nextRandom64(Random *r) {
+
+  uint64_t *s = r->s;
+  uint64_t x = s[1] * 5;
+  uint64_t result = ((x << 7) | (x >> 57)) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 45) | (s[3] >> 19);
+  return result;
+}
+
+void defaultWorkload(WorkloadConfig *);
+
+int setWorkloadOption(WorkloadConfig *, const char *);
+
+int parseWorkload(WorkloadConfig *, const char *);
+
+int openWorkload(Workload *, const WorkloadConfig *);
+
+size_t nextWorkloadBatch(Workload *, TraceAccess *, size_t);
+
+void closeWorkload(Workload *);
+
+#endif
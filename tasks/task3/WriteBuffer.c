@@ -0,0 +1,119 @@
+/*******************************************************************************
+*                                                                              *
+*                      Coalescing write buffer                                 *
+*                                                                              *
+*******************************************************************************/
+
+/*------------------------------------------------------------------------------
+The queue behind a cache level's outgoing writes (write-throughs, writes
+that do not allocate, dirty evictions). Each entry covers one block and
+remembers which of its bytes were written, so stores to a block that is
+already waiting cost nothing more.
+
+Only the bookkeeping lives here; when and how an entry drains into the next
+level is decided by the hierarchy (L2Cache2w.c). Entries are identified by
+their position in age order, 0 being the oldest.
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "WriteBuffer.h"
+
+const char *const WritePolicyNames[] = {"back", "through", NULL};
+
+/*------------------------------------------------------------------------------
+Room for entries blocks of blockSize bytes, with their data unless
+withData is 0. Returns 0 on success, -1 if out of memory.
+------------------------------------------------------------------------------*/
+int initWriteBuffer(WriteBuffer *buffer, uint32_t entries, uint32_t blockSize, int withData) {
+
+  memset(buffer, 0, sizeof(*buffer));
+  buffer->capacity = entries;
+  buffer->blockSize = blockSize;
+  buffer->order = malloc(entries * sizeof(uint32_t));
+  buffer->blocks = malloc(entries * sizeof(uint64_t));
+  buffer->queued = malloc(entries * sizeof(uint64_t));
+  buffer->valid = malloc((size_t)entries * blockSize);
+  buffer->data = withData ? malloc((size_t)entries * blockSize) : NULL;
+
+  if (!buffer->order || !buffer->blocks || !buffer->queued || !buffer->valid ||
+      (withData && !buffer->data)) {
+    freeWriteBuffer(buffer);
+    return -1;
+  }
+
+  clearWriteBuffer(buffer);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+Drops every queued write.
+------------------------------------------------------------------------------*/
+void clearWriteBuffer(WriteBuffer *buffer) {
+  buffer->count = 0;
+  buffer->drainTime = 0;
+}
+
+void freeWriteBuffer(WriteBuffer *buffer) {
+  free(buffer->order);
+  free(buffer->blocks);
+  free(buffer->queued);
+  free(buffer->valid);
+  free(buffer->data);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+/*------------------------------------------------------------------------------
+Position of the entry for block (a block address), or -1.
+------------------------------------------------------------------------------*/
+int findWriteBuffer(const WriteBuffer *buffer, uint64_t block) {
+  for (uint32_t i = 0; i < buffer->count; i++) {
+    if (buffer->blocks[buffer->order[i]] == block)
+      return (int)i;
+  }
+  return -1;
+}
+
+/*------------------------------------------------------------------------------
+Queues size bytes at address (all in one block) at time now, merging them
+into the block's entry if there is one. A new entry needs a free slot.
+Returns 1 if the write was merged, 0 if it took a new entry.
+------------------------------------------------------------------------------*/
+int putWriteBuffer(WriteBuffer *buffer, uint64_t address, const uint8_t *data,
+                   uint32_t size, uint64_t now) {
+
+  uint64_t block = address & ~(uint64_t)(buffer->blockSize - 1);
+  uint32_t offset = (uint32_t)(address - block);
+  int position = findWriteBuffer(buffer, block);
+  int merged = position >= 0;
+  uint32_t slot;
+
+  if (merged)
+    slot = buffer->order[position];
+  else {
+    // the lowest slot not in use
+    uint8_t used[MAX_WRITE_BUFFER] = {0};
+    for (uint32_t i = 0; i < buffer->count; i++)
+      used[buffer->order[i]] = 1;
+    for (slot = 0; used[slot]; slot++)
+      ;
+    buffer->order[buffer->count++] = slot;
+    buffer->blocks[slot] = block;
+    buffer->queued[slot] = now;
+    memset(&buffer->valid[(size_t)slot * buffer->blockSize], 0, buffer->blockSize);
+  }
+
+  memset(&buffer->valid[(size_t)slot * buffer->blockSize + offset], 1, size);
+  if (buffer->data && data)
+    memcpy(&buffer->data[(size_t)slot * buffer->blockSize + offset], data, size);
+  return merged;
+}
+
+/*------------------------------------------------------------------------------
+Forgets the entry at position (once it has been written to the next level).
+------------------------------------------------------------------------------*/
+void removeWriteBuffer(WriteBuffer *buffer, uint32_t position) {
+  buffer->count--;
+  memmove(&buffer->order[position], &buffer->order[position + 1],
+          (buffer->count - position) * sizeof(uint32_t));
+}
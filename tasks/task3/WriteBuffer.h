@@ -0,0 +1,41 @@
+#ifndef WRITEBUFFER_H
+#define WRITEBUFFER_H
+
+#include <stdint.h>
+
+#define MAX_WRITE_BUFFER 64   // entries
+
+typedef enum WritePolicy {
+  WRITE_BACK,     /* dirty lines are written when evicted */
+  WRITE_THROUGH   /* every write also goes to the next level */
+} WritePolicy;
+
+extern const char *const WritePolicyNames[];
+
+/* Writes on their way to the next level, one entry per block, oldest first.
+   Writes to a block already queued are merged into its entry. */
+typedef struct WriteBuffer {
+  uint32_t capacity;
+  uint32_t count;
+  uint32_t blockSize;
+  uint32_t *order;     /* slots, oldest first */
+  uint64_t *blocks;    /* per slot: block address */
+  uint64_t *queued;    /* per slot: time of the first write */
+  uint8_t *valid;      /* per slot: blockSize bytes, 1 = written */
+  uint8_t *data;       /* per slot: blockSize bytes, NULL in timing only mode */
+  uint64_t drainTime;  /* when the previous drain ends */
+} WriteBuffer;
+
+int initWriteBuffer(WriteBuffer *, uint32_t, uint32_t, int);
+
+void clearWriteBuffer(WriteBuffer *);
+
+void freeWriteBuffer(WriteBuffer *);
+
+int findWriteBuffer(const WriteBuffer *, uint64_t);
+
+int putWriteBuffer(WriteBuffer *, uint64_t, const uint8_t *, uint32_t, uint64_t);
+
+void removeWriteBuffer(WriteBuffer *, uint32_t);
+
+#endif